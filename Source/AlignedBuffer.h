@@ -0,0 +1,59 @@
+/*
+  ==============================================================================
+
+    Scratch storage for the DSP kernels, aligned and padded for SIMDRegister.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <vector>
+
+/*
+ Owns a float buffer whose start is SIMD aligned and whose length is rounded up
+ to a whole number of SIMD registers, so the kernels can use aligned loads on
+ every element without a scalar tail. Only call allocate() off the audio thread.
+ */
+template <typename SampleType>
+struct AlignedBuffer
+{
+   #if JUCE_USE_SIMD
+    using SIMD = juce::dsp::SIMDRegister<SampleType>;
+    static constexpr int lanes = (int) SIMD::SIMDNumElements;
+   #else
+    static constexpr int lanes = 1;
+   #endif
+
+    static int roundUpToLanes(int numSamples)
+    {
+        return (numSamples + lanes - 1) / lanes * lanes;
+    }
+
+    void allocate(int numSamples)
+    {
+        size = roundUpToLanes(numSamples);
+        storage.assign((size_t) (size + lanes), SampleType(0));
+
+       #if JUCE_USE_SIMD
+        data = SIMD::getNextSIMDAlignedPtr(storage.data());
+       #else
+        data = storage.data();
+       #endif
+    }
+
+    void clear()
+    {
+        std::fill(storage.begin(), storage.end(), SampleType(0));
+    }
+
+    SampleType* get() const noexcept            { return data; }
+    int getSize() const noexcept                { return size; }
+
+private:
+    std::vector<SampleType> storage;
+    SampleType* data = nullptr;
+    int size = 0;
+};
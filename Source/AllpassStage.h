@@ -0,0 +1,177 @@
+/*
+  ==============================================================================
+
+    Polarity flip, first order allpass, dry/wet and output gain, after the
+    gain computer.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "AlignedBuffer.h"
+#include "ChannelLanes.h"
+
+/*
+ For every sample: flip the polarity of the compressed signal, average it with
+ its first order allpass, then mix that with the dry input. The output gain is
+ folded into the dry and wet gains, so it costs nothing on top of the mix.
+
+ The allpass is recursive, so it can't be vectorised along time. With more than
+ one channel it runs across channels instead, one SIMDRegister per sample with
+ a channel in each lane (see ChannelLanes.h). Both paths keep their state in
+ the same per-channel array, so they can be switched between blocks.
+ */
+template <typename SampleType>
+class AllpassStage
+{
+public:
+    using Block = juce::dsp::AudioBlock<SampleType>;
+
+    void prepare(int numChannels, int maximumBlockSize)
+    {
+        maxBlockSize = maximumBlockSize;
+        state.allocate(numChannels);
+        input.allocate(maximumBlockSize * lanes);
+        gains.allocate(maximumBlockSize * lanes);
+    }
+
+    void reset()
+    {
+        state.clear();
+    }
+
+    void setCoefficient(SampleType newCoefficient)  { a1 = newCoefficient; }
+    void setMix(SampleType newMix)                  { mix = newMix; }
+    void setOutputGain(SampleType newGain)          { outputGain = newGain; }
+
+    // on by default; off forces the per-channel loop, for comparing the two
+    void setChannelLanesEnabled(bool shouldBeEnabled)   { useChannelLanes = shouldBeEnabled; }
+
+    // gainRows[channel] holds the gain computer's output for that channel
+    void process(const Block& block, const SampleType* const* gainRows) noexcept
+    {
+        jassert((int) block.getNumSamples() <= maxBlockSize);
+        jassert((int) block.getNumChannels() <= state.getSize());
+
+        const auto acrossChannels = ChannelLanes::isAvailable<SampleType>() && useChannelLanes && block.getNumChannels() > 1;
+
+        ChannelLanes::withChannelCount((int) block.getNumChannels(), [&](auto channelCount)
+        {
+            constexpr auto numChannels = decltype(channelCount)::value;
+
+            if (acrossChannels)
+                processAcrossChannels<numChannels>(block, gainRows);
+            else
+                processPerChannel<numChannels>(block, gainRows);
+        });
+    }
+
+private:
+    static constexpr int lanes = ChannelLanes::lanes<SampleType>;
+    static constexpr SampleType sign = SampleType(-1);
+
+    // NumChannels == 0 is the generic version, see ChannelLanes::withChannelCount
+    template <int NumChannels>
+    void processPerChannel(const Block& block, const SampleType* const* gainRows) noexcept
+    {
+        const auto numChannels = ChannelLanes::resolve<NumChannels>((int) block.getNumChannels());
+        const auto numSamples = (int) block.getNumSamples();
+
+        const auto dryGain = outputGain * (SampleType(1) - mix);
+        const auto wetGain = outputGain * mix;
+
+        for (auto channel = 0; channel < numChannels; ++channel)
+        {
+            auto* data = block.getChannelPointer((size_t) channel);
+            const auto* compressionGain = gainRows[channel];
+            auto s = state.get()[channel];
+
+            for (auto sample = 0; sample < numSamples; ++sample)
+            {
+                const auto dry = data[sample];
+                const auto output = dry * SampleType(-1) * compressionGain[sample]; // flip polarity
+
+                const auto allPassFilteredSample = a1 * output + s;
+                s = output - a1 * allPassFilteredSample;
+
+                const auto filterOutput = SampleType(0.5) * (output + sign * allPassFilteredSample);
+
+                data[sample] = dryGain * dry + wetGain * filterOutput;
+            }
+
+            state.get()[channel] = s;
+        }
+    }
+
+    template <int NumChannels>
+    void processAcrossChannels(const Block& block, const SampleType* const* gainRows) noexcept
+    {
+       #if JUCE_USE_SIMD
+        using SIMD = juce::dsp::SIMDRegister<SampleType>;
+
+        const auto numChannels = ChannelLanes::resolve<NumChannels>((int) block.getNumChannels());
+        const auto numSamples = (int) block.getNumSamples();
+
+        const auto coefficient = SIMD::expand(a1);
+        const auto wet = SIMD::expand(outputGain * mix);
+        const auto dryGain = SIMD::expand(outputGain * (SampleType(1) - mix));
+        const auto half = SIMD::expand(SampleType(0.5));
+        const auto flip = SIMD::expand(SampleType(-1));
+        const auto filterSign = SIMD::expand(sign);
+
+        for (auto first = 0; first < numChannels; first += lanes)
+        {
+            const auto count = juce::jmin(lanes, numChannels - first);
+
+            SampleType* channels[lanes] {};
+            const SampleType* channelGains[lanes] {};
+
+            for (auto lane = 0; lane < count; ++lane)
+            {
+                channels[lane] = block.getChannelPointer((size_t) (first + lane));
+                channelGains[lane] = gainRows[first + lane];
+            }
+
+            ChannelLanes::interleave(channels, count, input.get(), numSamples);
+            ChannelLanes::interleave(channelGains, count, gains.get(), numSamples);
+
+            auto s = SIMD::fromRawArray(state.get() + first);
+
+            for (auto sample = 0; sample < numSamples; ++sample)
+            {
+                auto* frame = input.get() + sample * lanes;
+
+                const auto dry = SIMD::fromRawArray(frame);
+                const auto output = dry * flip * SIMD::fromRawArray(gains.get() + sample * lanes);
+
+                const auto allPassFilteredSample = coefficient * output + s;
+                s = output - coefficient * allPassFilteredSample;
+
+                const auto filterOutput = half * (output + filterSign * allPassFilteredSample);
+
+                (dryGain * dry + wet * filterOutput).copyToRawArray(frame);
+            }
+
+            s.copyToRawArray(state.get() + first);
+
+            ChannelLanes::deinterleave(input.get(), channels, count, numSamples);
+        }
+       #else
+        processPerChannel<NumChannels>(block, gainRows);
+       #endif
+    }
+
+    SampleType a1 = 0;
+    SampleType mix = SampleType(0.5);
+    SampleType outputGain = 1;
+    bool useChannelLanes = true;
+    int maxBlockSize = 0;
+
+    // one value per channel, padded to whole groups of lanes
+    AlignedBuffer<SampleType> state;
+
+    // one group of channels, interleaved
+    AlignedBuffer<SampleType> input, gains;
+};
@@ -0,0 +1,98 @@
+/*
+  ==============================================================================
+
+    Channel <-> SIMD lane shuffles for the recursive filters.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "AlignedBuffer.h"
+
+#include <type_traits>
+
+/*
+ A recursive filter can't be vectorised along time, every output needs the one
+ before it. It can be vectorised across channels: put sample i of channel c in
+ lane c of vector i, and the recursion walks through time one vector per sample
+ with each lane carrying its own channel.
+
+ Channels are handled in groups of `lanes`. The lanes past the last channel of
+ a group are zero and are thrown away when the group is written back.
+
+ The kernels are templated on the channel count. withChannelCount() picks a
+ compile-time count for the layouts we expect (mono, stereo, 5.1, 7.1, 7.1.4),
+ so their channel loops unroll; anything else runs the generic version, which
+ is instantiated with 0 and reads the count at run time.
+ */
+namespace ChannelLanes
+{
+    // four floats or two doubles per register on SSE/NEON
+    template <typename SampleType>
+    constexpr int lanes = AlignedBuffer<SampleType>::lanes;
+
+    template <typename SampleType>
+    constexpr bool isAvailable() noexcept           { return lanes<SampleType> > 1; }
+
+    template <int NumChannels>
+    using ChannelCount = std::integral_constant<int, NumChannels>;
+
+    // NumChannels when it is fixed at compile time, otherwise the run time count
+    template <int NumChannels>
+    constexpr int resolve(int numChannels) noexcept
+    {
+        return NumChannels > 0 ? NumChannels : numChannels;
+    }
+
+    // calls kernel(ChannelCount<N>{}), N = 0 meaning "generic"
+    template <typename Kernel>
+    void withChannelCount(int numChannels, Kernel&& kernel)
+    {
+        switch (numChannels)
+        {
+            case 1:     kernel(ChannelCount<1>{});  break;
+            case 2:     kernel(ChannelCount<2>{});  break;
+            case 6:     kernel(ChannelCount<6>{});  break;
+            case 8:     kernel(ChannelCount<8>{});  break;
+            case 12:    kernel(ChannelCount<12>{}); break;
+            default:    kernel(ChannelCount<0>{});  break;
+        }
+    }
+
+    // channels[0, numChannels) -> dest[i * lanes + channel]
+    template <typename SampleType>
+    void interleave(const SampleType* const* channels, int numChannels, SampleType* dest, int numSamples) noexcept
+    {
+        constexpr auto width = lanes<SampleType>;
+        jassert(numChannels <= width);
+
+        for (auto i = 0; i < numSamples; ++i)
+        {
+            auto* frame = dest + i * width;
+
+            for (auto channel = 0; channel < numChannels; ++channel)
+                frame[channel] = channels[channel][i];
+
+            for (auto channel = numChannels; channel < width; ++channel)
+                frame[channel] = SampleType(0);
+        }
+    }
+
+    // src[i * lanes + channel] -> channels[0, numChannels)
+    template <typename SampleType>
+    void deinterleave(const SampleType* src, SampleType* const* channels, int numChannels, int numSamples) noexcept
+    {
+        constexpr auto width = lanes<SampleType>;
+        jassert(numChannels <= width);
+
+        for (auto i = 0; i < numSamples; ++i)
+        {
+            const auto* frame = src + i * width;
+
+            for (auto channel = 0; channel < numChannels; ++channel)
+                channels[channel][i] = frame[channel];
+        }
+    }
+}
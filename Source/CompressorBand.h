@@ -0,0 +1,249 @@
+/*
+  ==============================================================================
+
+    Compressor for one band of the crossover.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "FastMath.h"
+#include "Lookahead.h"
+#include "ParameterSnapshot.h"
+
+#include <utility>
+#include <vector>
+
+/*
+ Same peak ballistics and gain curve as juce::dsp::Compressor, sample by sample
+ so the crossover loop can feed it one band value at a time. The settings come
+ in as a BandParameters, and only the coefficients whose setting moved are
+ recomputed. The band's parameters themselves live in BandControls.
+
+ The band doesn't delay its audio itself: with lookahead, getGain() is fed
+ the band undelayed and its window peak, and the gain it returns goes on the
+ band as it comes out of the caller's LookaheadDelay. process() and
+ processSample() apply the gain to the input as it is, for a caller without
+ lookahead.
+
+ Bypass and mute fade over fadeSeconds. Once a fade is over, a bypassed band
+ returns unity gain and a muted one silence, so neither pays for the detector
+ or the gain.
+ */
+template <typename SampleType>
+class CompressorBand
+{
+public:
+    void prepare(const juce::dsp::ProcessSpec& spec, int maximumLookaheadSamples = 0)
+    {
+        envelope.assign(spec.numChannels, SampleType(0));
+        window.prepare((int) spec.numChannels, maximumLookaheadSamples);
+        setSampleRate(spec.sampleRate);
+    }
+
+    // doesn't allocate, so the oversampling factor can change on the audio thread
+    void setSampleRate(double sampleRate)
+    {
+        expFactor = -2.0 * juce::MathConstants<double>::pi * 1000.0 / sampleRate;
+        fadeStep = SampleType(1) / (SampleType) juce::jmax(1.0, fadeSeconds * sampleRate);
+
+        // the attack/release constants depend on the sample rate
+        needsUpdate = true;
+        updateCompressorSettings(settings);
+        reset();
+    }
+
+    void reset()
+    {
+        std::fill(envelope.begin(), envelope.end(), SampleType(0));
+        window.reset();
+        minimumGain = SampleType(1);
+
+        // a band starting from scratch has nothing to fade from
+        level.snap();
+        amount.snap();
+    }
+
+    // the window the detector looks over, the caller delays the audio by as much
+    void setLookahead(int numSamples)
+    {
+        window.setLength(numSamples);
+    }
+
+    // true once every channel's envelope is back under the threshold, i.e. at unity gain
+    bool isSettled() const noexcept
+    {
+        if (level.isAt(0) || amount.isAt(0))
+            return true;
+
+        for (auto env : envelope)
+            if (env >= thresholdGain)
+                return false;
+
+        return true;
+    }
+
+    // only recomputes the coefficients whose settings changed since the last call
+    void updateCompressorSettings(const BandParameters& newSettings)
+    {
+        if (needsUpdate || newSettings.thresholdDb != settings.thresholdDb)
+        {
+            thresholdGain = juce::Decibels::decibelsToGain((SampleType) newSettings.thresholdDb, SampleType(-200));
+            thresholdInverse = SampleType(1) / thresholdGain;
+        }
+
+        if (needsUpdate || newSettings.attackMs != settings.attackMs)
+            cteAttack = calculateCte(newSettings.attackMs);
+
+        if (needsUpdate || newSettings.releaseMs != settings.releaseMs)
+            cteRelease = calculateCte(newSettings.releaseMs);
+
+        if (needsUpdate || newSettings.ratio != settings.ratio)
+            ratioExponent = SampleType(1) / (SampleType) newSettings.ratio - SampleType(1);
+
+        settings = newSettings;
+        amount.target = settings.bypassed ? SampleType(0) : SampleType(1);
+        needsUpdate = false;
+    }
+
+    // how the gain curve's pow() is worked out, see FastMath.h
+    void setPrecision(MathPrecision newPrecision)
+    {
+        precision = newPrecision;
+    }
+
+    // false mutes the band: muted, or another band is soloed
+    void setAudible(bool shouldBeAudible)
+    {
+        level.target = shouldBeAudible ? SampleType(1) : SampleType(0);
+    }
+
+    void process(juce::AudioBuffer<SampleType>& buffer)
+    {
+        startBlock(buffer.getNumSamples());
+
+        for (auto channel = 0; channel < buffer.getNumChannels(); ++channel)
+        {
+            auto* data = buffer.getWritePointer(channel);
+
+            for (auto sample = 0; sample < buffer.getNumSamples(); ++sample)
+                data[sample] = processSample(channel, sample, data[sample]);
+        }
+    }
+
+    // before the processSample() calls for a block, with the block's length
+    void startBlock(int numSamples) noexcept
+    {
+        // coming back from a bypass or a mute, the window peak is stale and the
+        // envelope was left wherever it was when the band stopped
+        if ((level.value == 0 && level.target > 0) || (amount.value == 0 && amount.target > 0))
+        {
+            window.clear();
+            std::fill(envelope.begin(), envelope.end(), SampleType(0));
+        }
+
+        level.start(fadeStep, numSamples);
+        amount.start(fadeStep, numSamples);
+        fading = level.isFading() || amount.isFading();
+    }
+
+    // getGain() applied to the input itself; call startBlock() once per block first
+    SampleType processSample(int channel, int index, SampleType input) noexcept
+    {
+        return getGain(channel, index, input) * input;
+    }
+
+    /* Detects on `input`, the band undelayed, and returns what to multiply the
+       band by as it comes out of the lookahead delay, fades included. For the
+       crossover loop, call startBlock() once per block first.
+     */
+    SampleType getGain(int channel, int index, SampleType input) noexcept
+    {
+        if (! fading)
+        {
+            if (level.isAt(0))
+                return SampleType(0);
+
+            if (amount.isAt(0))
+                return SampleType(1);
+        }
+
+        const auto peak = window.process(channel, std::abs(input));
+
+        auto& env = envelope[(size_t) channel];
+        env = peak + (peak > env ? cteAttack : cteRelease) * (env - peak);
+
+        const auto gain = env < thresholdGain ? SampleType(1) : computeGain(env);
+        minimumGain = juce::jmin(minimumGain, gain);
+
+        if (! fading)
+            return gain;
+
+        // part of the gain reduction while bypassing, part of the band while muting
+        return level.at(index) * (SampleType(1) + amount.at(index) * (gain - SampleType(1)));
+    }
+
+    // the deepest gain reduction since the last call, for the meters
+    SampleType getAndResetMinimumGain() noexcept
+    {
+        return std::exchange(minimumGain, SampleType(1));
+    }
+
+private:
+    static constexpr double fadeSeconds = 0.005;
+
+    // 0..1, ramping linearly to a target of 0 or 1
+    struct Fade
+    {
+        SampleType value = 1, target = 1, from = 1, step = 0;
+
+        void snap() noexcept                        { value = from = target; step = 0; }
+        bool isAt(SampleType v) const noexcept      { return value == v && target == v; }
+        bool isFading() const noexcept              { return step != 0; }
+
+        void start(SampleType fadeStep, int numSamples) noexcept
+        {
+            from = value;
+            step = value == target ? SampleType(0) : (target > value ? fadeStep : -fadeStep);
+            value = juce::jlimit(SampleType(0), SampleType(1), value + step * (SampleType) numSamples);
+        }
+
+        // the value after the index'th sample of the block
+        SampleType at(int index) const noexcept
+        {
+            return juce::jlimit(SampleType(0), SampleType(1), from + step * (SampleType) (index + 1));
+        }
+    };
+
+    // (env / threshold)^(1/ratio - 1), for an envelope over the threshold
+    SampleType computeGain(SampleType env) const noexcept
+    {
+        if (precision == MathPrecision::fast)
+            return FastMath::exp2(ratioExponent * FastMath::log2(env * thresholdInverse));
+
+        return std::pow(env * thresholdInverse, ratioExponent);
+    }
+
+    SampleType calculateCte(float timeMs) const
+    {
+        return timeMs < 1.0e-3f ? SampleType(0) : (SampleType) std::exp(expFactor / timeMs);
+    }
+
+    double expFactor = 0.0;
+    SampleType thresholdGain = 1, thresholdInverse = 1;
+    SampleType ratioExponent = 0;
+    SampleType cteAttack = 0, cteRelease = 0;
+    std::vector<SampleType> envelope;
+    SampleType minimumGain = 1;
+    WindowPeak<SampleType> window;
+
+    BandParameters settings;
+    bool needsUpdate = true;
+    MathPrecision precision = MathPrecision::exact;
+
+    Fade level, amount; // how much of the band is heard, and how much of its compression
+    SampleType fadeStep = 0;
+    bool fading = false;
+};
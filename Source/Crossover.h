@@ -0,0 +1,138 @@
+/*
+  ==============================================================================
+
+    Three-band Linkwitz-Riley crossover.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <vector>
+
+/*
+ 4th order (24 dB/oct) Linkwitz-Riley split into low, mid and high:
+
+    low  = AP2 * LP1 * x
+    mid  = LP2 * HP1 * x
+    high = HP2 * HP1 * x
+
+ The allpass on the low band matches the phase the mid and high bands pick up
+ from the second split, so low + mid + high = AP2 * AP1 * x: flat magnitude,
+ only the phase moves.
+
+ The filters are the same TPT structure juce::dsp::LinkwitzRileyFilter uses, but
+ all three filters of a channel keep their state in one struct, so a sample goes
+ through the whole split touching a single cache line.
+ */
+template <typename SampleType>
+class ThreeBandCrossover
+{
+public:
+    void prepare(double newSampleRate, int numChannels)
+    {
+        state.resize((size_t) numChannels);
+        setSampleRate(newSampleRate);
+    }
+
+    // doesn't allocate, so the oversampling factor can change on the audio thread
+    void setSampleRate(double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+
+        updateCoefficients(lowMid, lowMidFrequency);
+        updateCoefficients(midHigh, midHighFrequency);
+        reset();
+    }
+
+    void reset()
+    {
+        std::fill(state.begin(), state.end(), ChannelState{});
+    }
+
+    void setCrossoverFrequencies(float newLowMidFrequency, float newMidHighFrequency)
+    {
+        if (newLowMidFrequency != lowMidFrequency)
+        {
+            lowMidFrequency = newLowMidFrequency;
+            updateCoefficients(lowMid, lowMidFrequency);
+        }
+
+        if (newMidHighFrequency != midHighFrequency)
+        {
+            midHighFrequency = newMidHighFrequency;
+            updateCoefficients(midHigh, midHighFrequency);
+        }
+    }
+
+    void processSample(int channel, SampleType input, SampleType& low, SampleType& mid, SampleType& high) noexcept
+    {
+        auto& s = state[(size_t) channel];
+        SampleType lowMidHigh;
+
+        split(lowMid, s.lowMid, input, low, lowMidHigh);
+        low = allpass(midHigh, s.allpass, low);
+        split(midHigh, s.midHigh, lowMidHigh, mid, high);
+    }
+
+private:
+    struct Coefficients
+    {
+        SampleType g = 0, h = 0;
+    };
+
+    struct ChannelState
+    {
+        SampleType lowMid[4] {};
+        SampleType allpass[2] {};
+        SampleType midHigh[4] {};
+    };
+
+    static constexpr SampleType R2 = juce::MathConstants<SampleType>::sqrt2;
+
+    void updateCoefficients(Coefficients& c, float frequency) const
+    {
+        const auto nyquistSafe = juce::jmin((double) frequency, sampleRate * 0.499);
+
+        c.g = (SampleType) std::tan(juce::MathConstants<double>::pi * nyquistSafe / sampleRate);
+        c.h = SampleType(1) / (SampleType(1) + R2 * c.g + c.g * c.g);
+    }
+
+    static void split(const Coefficients& c, SampleType* s, SampleType x, SampleType& low, SampleType& high) noexcept
+    {
+        const auto yH = (x - (R2 + c.g) * s[0] - s[1]) * c.h;
+        const auto yB = c.g * yH + s[0];
+        s[0] = c.g * yH + yB;
+        const auto yL = c.g * yB + s[1];
+        s[1] = c.g * yB + yL;
+
+        const auto yH2 = (yL - (R2 + c.g) * s[2] - s[3]) * c.h;
+        const auto yB2 = c.g * yH2 + s[2];
+        s[2] = c.g * yH2 + yB2;
+        const auto yL2 = c.g * yB2 + s[3];
+        s[3] = c.g * yB2 + yL2;
+
+        low = yL2;
+        high = yL - R2 * yB + yH - yL2;
+    }
+
+    static SampleType allpass(const Coefficients& c, SampleType* s, SampleType x) noexcept
+    {
+        const auto yH = (x - (R2 + c.g) * s[0] - s[1]) * c.h;
+        const auto yB = c.g * yH + s[0];
+        s[0] = c.g * yH + yB;
+        const auto yL = c.g * yB + s[1];
+        s[1] = c.g * yB + yL;
+
+        return yL - R2 * yB + yH;
+    }
+
+    double sampleRate = 48000.0;
+    float lowMidFrequency = 400.0f;
+    float midHighFrequency = 2000.0f;
+
+    Coefficients lowMid, midHigh;
+    std::vector<ChannelState> state;
+};
@@ -0,0 +1,287 @@
+/*
+  ==============================================================================
+
+    Meters, gain-reduction history and parameter controls for the editor.
+
+  ==============================================================================
+*/
+
+#include "EditorComponents.h"
+
+namespace
+{
+const auto backgroundColour = juce::Colour(0xff16191c);
+const auto gridColour = juce::Colour(0xff2c3136);
+const auto historyColour = juce::Colour(0xffe0a030);
+
+constexpr auto fallPerUpdate = 0.015f;   // about 1.5 s from full scale to empty at 30 Hz
+constexpr auto repaintThreshold = 0.002f;
+}
+
+//==============================================================================
+Meter::Meter(const juce::String& name, float minimum, float maximum, Direction newDirection, juce::Colour newColour)
+    : juce::Component(name), minimumDb(minimum), maximumDb(maximum), direction(newDirection), colour(newColour)
+{
+    setOpaque(true);
+}
+
+float Meter::toProportion(float db) const
+{
+    return juce::jlimit(0.0f, 1.0f, (db - minimumDb) / (maximumDb - minimumDb));
+}
+
+void Meter::update(float barDb, float markerDb)
+{
+    const auto newBar = juce::jmax(toProportion(barDb), bar - fallPerUpdate);
+    const auto newMarker = juce::jmax(toProportion(markerDb), marker - fallPerUpdate);
+
+    if (std::abs(newBar - bar) < repaintThreshold && std::abs(newMarker - marker) < repaintThreshold)
+        return;
+
+    bar = newBar;
+    marker = newMarker;
+    repaint();
+}
+
+void Meter::paint(juce::Graphics& g)
+{
+    g.fillAll(backgroundColour);
+
+    auto bounds = getLocalBounds().toFloat().reduced(1.0f);
+    const auto height = bounds.getHeight();
+
+    const auto barHeight = bar * height;
+    const auto markerY = direction == Direction::up ? bounds.getBottom() - marker * height
+                                                    : bounds.getY() + marker * height;
+
+    g.setColour(colour.withAlpha(0.8f));
+    g.fillRect(direction == Direction::up ? bounds.removeFromBottom(barHeight)
+                                          : bounds.removeFromTop(barHeight));
+
+    g.setColour(colour.brighter());
+    g.drawHorizontalLine(juce::roundToInt(markerY), 1.0f, (float) getWidth() - 1.0f);
+}
+
+//==============================================================================
+GainReductionHistory::GainReductionHistory(float maximum)
+    : maximumDb(maximum)
+{
+    setOpaque(true);
+    pending.reserve(256);
+}
+
+void GainReductionHistory::push(float gainReductionDb)
+{
+    // the editor only ticks while it's visible, so this stays small
+    pending.push_back(gainReductionDb);
+}
+
+void GainReductionHistory::flush()
+{
+    if (pending.empty() || ! image.isValid())
+    {
+        pending.clear();
+        return;
+    }
+
+    const auto width = image.getWidth();
+    const auto height = image.getHeight();
+    const auto numNew = juce::jmin((int) pending.size(), width);
+
+    // scroll what is already drawn, then draw only the new columns
+    if (numNew < width)
+        image.moveImageSection(0, 0, numNew, 0, width - numNew, height);
+
+    juce::Graphics g(image);
+    const auto first = pending.size() - (size_t) numNew;
+
+    for (auto i = 0; i < numNew; ++i)
+        drawColumn(g, width - numNew + i, pending[first + (size_t) i]);
+
+    pending.clear();
+    repaint();
+}
+
+void GainReductionHistory::drawColumn(juce::Graphics& g, int x, float gainReductionDb) const
+{
+    const auto height = image.getHeight();
+    const auto depth = juce::roundToInt(juce::jlimit(0.0f, 1.0f, gainReductionDb / maximumDb) * (float) height);
+
+    g.setColour(backgroundColour);
+    g.fillRect(x, 0, 1, height);
+
+    // a grid line every 6 dB
+    g.setColour(gridColour);
+    for (auto db = 6.0f; db < maximumDb; db += 6.0f)
+        g.fillRect(x, juce::roundToInt(db / maximumDb * (float) height), 1, 1);
+
+    g.setColour(historyColour);
+    g.fillRect(x, 0, 1, depth);
+}
+
+void GainReductionHistory::paint(juce::Graphics& g)
+{
+    g.drawImageAt(image, 0, 0);
+}
+
+void GainReductionHistory::resized()
+{
+    // starts again empty; resizing is rare and keeping the old plot isn't worth a rescale
+    image = juce::Image(juce::Image::RGB, juce::jmax(1, getWidth()), juce::jmax(1, getHeight()), false);
+
+    juce::Graphics g(image);
+
+    for (auto x = 0; x < image.getWidth(); ++x)
+        drawColumn(g, x, 0.0f);
+}
+
+//==============================================================================
+StageProfileView::StageProfileView(StageProfiler& p)
+    : profiler(p)
+{
+    setOpaque(true);
+
+    dumpButton.onClick = [this] { dump(); };
+    clearButton.onClick = [this]
+    {
+        profiler.clear();
+        status.clear();
+        update();
+    };
+
+    addAndMakeVisible(dumpButton);
+    addAndMakeVisible(clearButton);
+    update();
+}
+
+void StageProfileView::update()
+{
+    auto column = [](const juce::String& text) { return text.paddedLeft(' ', 9); };
+    auto number = [&](double microseconds) { return column(juce::String(microseconds, 1)); };
+
+    juce::StringArray newRows;
+    newRows.add(juce::String("stage").paddedRight(' ', 14) + column("blocks") + column("mean")
+                + column("median") + column("p99") + column("max"));
+
+    for (auto i = 0; i < StageProfiler::numStages; ++i)
+    {
+        const auto stage = (ProfiledStage) i;
+        const auto summary = profiler.getSummary(stage);
+
+        newRows.add(juce::String(StageProfiler::getStageName(stage)).paddedRight(' ', 14)
+                    + column(juce::String((juce::int64) summary.numBlocks))
+                    + number(summary.mean) + number(summary.median) + number(summary.p99) + number(summary.max));
+    }
+
+    newRows.add("blocks over their deadline: " + juce::String((juce::int64) profiler.getNumOverruns())
+                + (status.isEmpty() ? juce::String() : "    " + status));
+
+    if (newRows != rows)
+    {
+        rows = newRows;
+        repaint();
+    }
+}
+
+void StageProfileView::dump()
+{
+    const auto file = juce::File::getSpecialLocation(juce::File::userDocumentsDirectory)
+                          .getChildFile("HatsOff Profile " + juce::Time::getCurrentTime().formatted("%Y-%m-%d %H-%M-%S") + ".txt");
+
+    status = profiler.writeDump(file) ? "written to " + file.getFullPathName()
+                                      : "could not write " + file.getFullPathName();
+    update();
+}
+
+void StageProfileView::paint(juce::Graphics& g)
+{
+    g.fillAll(backgroundColour);
+    g.setColour(juce::Colours::lightgrey);
+    g.setFont(juce::Font(juce::Font::getDefaultMonospacedFontName(), 12.0f, juce::Font::plain));
+
+    for (auto i = 0; i < rows.size(); ++i)
+        g.drawText(rows[i], 4, i * rowHeight, getWidth() - 8, rowHeight, juce::Justification::centredLeft, false);
+}
+
+void StageProfileView::resized()
+{
+    auto buttons = getLocalBounds().removeFromRight(80).reduced(4);
+    dumpButton.setBounds(buttons.removeFromTop(24));
+    buttons.removeFromTop(4);
+    clearButton.setBounds(buttons.removeFromTop(24));
+}
+
+//==============================================================================
+ParameterPanel::ParameterPanel(juce::AudioProcessorValueTreeState& apvts)
+{
+    for (auto* processorParameter : apvts.processor.getParameters())
+    {
+        auto* parameter = dynamic_cast<juce::RangedAudioParameter*>(processorParameter);
+
+        if (parameter == nullptr)
+            continue;
+
+        const auto& id = parameter->getParameterID();
+        auto control = std::make_unique<Control>();
+
+        control->label.setText(parameter->getName(64), juce::dontSendNotification);
+        control->label.setJustificationType(juce::Justification::centredRight);
+
+        if (auto* choice = dynamic_cast<juce::AudioParameterChoice*>(parameter))
+        {
+            auto comboBox = std::make_unique<juce::ComboBox>();
+            comboBox->addItemList(choice->choices, 1);
+            control->comboBoxAttachment = std::make_unique<APVTS::ComboBoxAttachment>(apvts, id, *comboBox);
+            control->editor = std::move(comboBox);
+        }
+        else if (dynamic_cast<juce::AudioParameterBool*>(parameter) != nullptr)
+        {
+            auto toggle = std::make_unique<juce::ToggleButton>();
+            control->buttonAttachment = std::make_unique<APVTS::ButtonAttachment>(apvts, id, *toggle);
+            control->editor = std::move(toggle);
+        }
+        else
+        {
+            auto slider = std::make_unique<juce::Slider>(juce::Slider::LinearHorizontal, juce::Slider::TextBoxRight);
+            slider->setTextBoxStyle(juce::Slider::TextBoxRight, false, 64, rowHeight - 6);
+            control->sliderAttachment = std::make_unique<APVTS::SliderAttachment>(apvts, id, *slider);
+            control->editor = std::move(slider);
+        }
+
+        addAndMakeVisible(control->label);
+        addAndMakeVisible(*control->editor);
+        controls.push_back(std::move(control));
+    }
+}
+
+int ParameterPanel::getNumColumns(int width) const
+{
+    return juce::jmax(1, width / columnWidth);
+}
+
+int ParameterPanel::getHeightForWidth(int width) const
+{
+    const auto numColumns = getNumColumns(width);
+    const auto numRows = ((int) controls.size() + numColumns - 1) / numColumns;
+    return numRows * rowHeight;
+}
+
+void ParameterPanel::resized()
+{
+    const auto numColumns = getNumColumns(getWidth());
+    const auto numRows = ((int) controls.size() + numColumns - 1) / numColumns;
+    const auto width = getWidth() / numColumns;
+
+    // down the first column, then the next, so the parameters keep their order
+    for (size_t i = 0; i < controls.size(); ++i)
+    {
+        const auto column = (int) i / juce::jmax(1, numRows);
+        const auto row = (int) i % juce::jmax(1, numRows);
+
+        juce::Rectangle<int> cell(column * width, row * rowHeight, width, rowHeight);
+        cell.reduce(4, 2);
+
+        controls[i]->label.setBounds(cell.removeFromLeft(cell.getWidth() * 2 / 5));
+        controls[i]->editor->setBounds(cell);
+    }
+}
@@ -0,0 +1,141 @@
+/*
+  ==============================================================================
+
+    Meters, gain-reduction history and parameter controls for the editor.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "StageProfiler.h"
+
+#include <memory>
+#include <vector>
+
+/*
+ A vertical bar with a marker line. Level meters fill up from minimumDb, gain
+ reduction meters hang down from the top. New values show at once when they
+ are higher and fall at a fixed rate otherwise, and the meter only repaints
+ when what it shows actually moved.
+ */
+class Meter  : public juce::Component
+{
+public:
+    enum class Direction { up, down };
+
+    Meter(const juce::String& name, float minimumDb, float maximumDb, Direction direction, juce::Colour colour);
+
+    // once per editor tick; for gain reduction pass the reduction, positive dB
+    void update(float barDb, float markerDb);
+
+    void paint(juce::Graphics&) override;
+
+private:
+    float toProportion(float db) const;
+
+    float minimumDb, maximumDb;
+    Direction direction;
+    juce::Colour colour;
+    float bar = 0.0f, marker = 0.0f; // 0..1 of the meter's height
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Meter)
+};
+
+/*
+ Scrolling plot of the gain reduction, one pixel column per meter frame. The
+ plot lives in an image: push() only queues values, and flush() scrolls the
+ image once by however many columns arrived and draws just those, so a tick
+ costs the same whether the plot is 100 or 1000 pixels wide. paint() is a
+ single image blit.
+ */
+class GainReductionHistory  : public juce::Component
+{
+public:
+    explicit GainReductionHistory(float maximumDb);
+
+    void push(float gainReductionDb);
+    void flush();
+
+    void paint(juce::Graphics&) override;
+    void resized() override;
+
+private:
+    void drawColumn(juce::Graphics&, int x, float gainReductionDb) const;
+
+    float maximumDb;
+    juce::Image image;
+    std::vector<float> pending;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (GainReductionHistory)
+};
+
+/*
+ The timings of a profiling build, one row per stage: mean, median, p99 and the
+ worst block, in microseconds. Dump writes the whole histogram to a text file
+ in the user's documents, Clear starts the statistics again.
+ */
+class StageProfileView  : public juce::Component
+{
+public:
+    explicit StageProfileView(StageProfiler&);
+
+    // a few times a second is plenty, the reader thread only drains every 100 ms
+    void update();
+
+    void paint(juce::Graphics&) override;
+    void resized() override;
+
+    static constexpr int rowHeight = 14;
+    static constexpr int preferredHeight = (StageProfiler::numStages + 2) * rowHeight;
+
+private:
+    void dump();
+
+    StageProfiler& profiler;
+    juce::StringArray rows;
+    juce::String status;
+    juce::TextButton dumpButton { "Dump" }, clearButton { "Clear" };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (StageProfileView)
+};
+
+/*
+ A labelled control for every parameter of the processor: combo boxes for the
+ choices, toggles for the switches and sliders for the rest, each attached to
+ the APVTS. Laid out in as many columns as fit.
+ */
+class ParameterPanel  : public juce::Component
+{
+public:
+    explicit ParameterPanel(juce::AudioProcessorValueTreeState&);
+
+    // the height needed to show every control at the given width
+    int getHeightForWidth(int width) const;
+
+    void resized() override;
+
+private:
+    using APVTS = juce::AudioProcessorValueTreeState;
+
+    struct Control
+    {
+        juce::Label label;
+        std::unique_ptr<juce::Component> editor;
+
+        // declared after the editor, so they are destroyed before it
+        std::unique_ptr<APVTS::SliderAttachment> sliderAttachment;
+        std::unique_ptr<APVTS::ComboBoxAttachment> comboBoxAttachment;
+        std::unique_ptr<APVTS::ButtonAttachment> buttonAttachment;
+    };
+
+    static constexpr int columnWidth = 280;
+    static constexpr int rowHeight = 28;
+
+    int getNumColumns(int width) const;
+
+    std::vector<std::unique_ptr<Control>> controls;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ParameterPanel)
+};
@@ -0,0 +1,315 @@
+/*
+  ==============================================================================
+
+    Approximate log2/exp2 and dB conversions for the detector paths.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/*
+ The detectors only need their logs and exps to a small fraction of a dB, not
+ to the last bit, so these split the float into exponent and mantissa and fit
+ a polynomial to the mantissa:
+
+ - log2(x) = e + p(m - 1) for x = m * 2^e with 1 <= m < 2, where p is a
+   degree 6 minimax fit of log2(1 + t) with p(0) = 0
+ - exp2(x) = 2^floor(x) * q(x - floor(x)), q a degree 5 minimax fit of 2^f
+   with q(0) = 1
+
+ Error bounds, measured in float over every float in range:
+ - log2: off by at most 3.9e-6 + 0.5 ulp of the result, for positive normal x
+ - exp2: relative error at most 1.9e-7, for -126 <= x <= 127; x is clamped there
+ - gainToDecibels: off by at most 4.5e-5 dB + 0.5 ulp of the result
+ - decibelsToGain: relative error at most 3.1e-6 (2.7e-5 dB) between -760
+   and +760 dB, most of it from rounding the scaled argument at the ends
+ The double versions use the same polynomials, so they are hardly more
+ accurate: 2.1e-6 for log2 and 8.4e-8 for exp2, over -1022 to 1023.
+
+ log2(1) and exp2(0) are exact, so a level at 0 dB stays at unity gain. Zero,
+ negative, denormal and non-finite inputs to log2 give meaningless results;
+ the callers clamp to a floor first.
+
+ Every function comes as a scalar version with no branches and no table, and
+ as a SIMDRegister version for float and double that does the same bit work
+ lane by lane. SIMDRegister has no integer to float conversions and no
+ shifts, so there:
+ - the exponent is moved into the mantissa of 2^mantissaBits, which then
+   reads as 2^mantissaBits plus the exponent
+ - exp2 rounds by adding 1.5 * 2^mantissaBits, which also leaves the integer
+   in the low bits, and takes one off where rounding went up
+ - the shifts go through an array of the register's lanes, which compiles to
+   the one packed shift
+ The SIMD versions give the same bits as the scalar ones. The block versions
+ run them over whole registers, and the scalar versions over what is left.
+ */
+namespace FastMath
+{
+    namespace detail
+    {
+        template <typename FloatType>
+        struct Format;
+
+        template <>
+        struct Format<float>
+        {
+            using Bits = uint32_t;
+            using Int = int32_t;
+            static constexpr int mantissaBits = 23;
+            static constexpr Int bias = 127;
+            static constexpr float minExponent = -126.0f, maxExponent = 127.0f;
+        };
+
+        template <>
+        struct Format<double>
+        {
+            using Bits = uint64_t;
+            using Int = int64_t;
+            static constexpr int mantissaBits = 52;
+            static constexpr Int bias = 1023;
+            static constexpr double minExponent = -1022.0, maxExponent = 1023.0;
+        };
+
+        template <typename To, typename From>
+        inline To bitCast(From from) noexcept
+        {
+            static_assert(sizeof(To) == sizeof(From), "bitCast needs types of the same size");
+            To to;
+            std::memcpy(&to, &from, sizeof(To));
+            return to;
+        }
+
+        // p and q from the comment above, for a float or a SIMDRegister of them
+        template <typename FloatType, typename Value>
+        inline Value log2Polynomial(Value t) noexcept
+        {
+            return t * (t * (t * (t * (t * (t * FloatType(-0.0264678451) + FloatType(0.123479185)) + FloatType(-0.27956528))
+                        + FloatType(0.458282706)) + FloatType(-0.718284154)) + FloatType(1.44255328));
+        }
+
+        template <typename FloatType, typename Value>
+        inline Value exp2Polynomial(Value f) noexcept
+        {
+            return f * (f * (f * (f * (f * FloatType(0.00186699058) + FloatType(0.00901732541)) + FloatType(0.0557997025))
+                        + FloatType(0.240164508)) + FloatType(0.693151307)) + FloatType(1);
+        }
+    }
+
+    template <typename FloatType>
+    inline FloatType log2(FloatType x) noexcept
+    {
+        static_assert(std::is_floating_point<FloatType>::value, "log2 needs float or double");
+        using Format = detail::Format<FloatType>;
+        using Bits = typename Format::Bits;
+
+        constexpr auto mantissaMask = (Bits(1) << Format::mantissaBits) - 1;
+        constexpr auto one = Bits(Format::bias) << Format::mantissaBits;
+
+        const auto bits = detail::bitCast<Bits>(x);
+        const auto exponent = (FloatType) ((typename Format::Int) (bits >> Format::mantissaBits) - Format::bias);
+        const auto t = detail::bitCast<FloatType>((bits & mantissaMask) | one) - FloatType(1);
+
+        return exponent + detail::log2Polynomial<FloatType>(t);
+    }
+
+    template <typename FloatType>
+    inline FloatType exp2(FloatType x) noexcept
+    {
+        static_assert(std::is_floating_point<FloatType>::value, "exp2 needs float or double");
+        using Format = detail::Format<FloatType>;
+        using Int = typename Format::Int;
+        using Bits = typename Format::Bits;
+
+        x = juce::jlimit(Format::minExponent, Format::maxExponent, x);
+
+        // floor() without the library call: truncate, then step down for negatives
+        auto whole = (Int) x;
+        whole -= (Int) (x < (FloatType) whole);
+        const auto f = x - (FloatType) whole;
+
+        const auto scale = detail::bitCast<FloatType>((Bits) (whole + Format::bias) << Format::mantissaBits);
+
+        return scale * detail::exp2Polynomial<FloatType>(f);
+    }
+
+    template <typename FloatType>
+    inline FloatType gainToDecibels(FloatType gain) noexcept
+    {
+        return FloatType(6.020599913279624) * log2(gain);   // 20 log10(2)
+    }
+
+    template <typename FloatType>
+    inline FloatType decibelsToGain(FloatType decibels) noexcept
+    {
+        return exp2(FloatType(0.16609640474436813) * decibels);   // log2(10) / 20
+    }
+
+   #if JUCE_USE_SIMD
+    namespace detail
+    {
+        template <typename FloatType>
+        using SIMD = juce::dsp::SIMDRegister<FloatType>;
+
+        // the same lanes as unsigned integers of their width
+        template <typename FloatType>
+        using SIMDBits = typename SIMD<FloatType>::vMaskType;
+
+        template <typename FloatType>
+        inline SIMDBits<FloatType> toBits(SIMD<FloatType> x) noexcept
+        {
+            return SIMDBits<FloatType>::fromNative(bitCast<typename SIMDBits<FloatType>::vSIMDType>(x.value));
+        }
+
+        template <typename FloatType>
+        inline SIMD<FloatType> fromBits(SIMDBits<FloatType> bits) noexcept
+        {
+            return SIMD<FloatType>::fromNative(bitCast<typename SIMD<FloatType>::vSIMDType>(bits.value));
+        }
+
+        template <int Shift, typename Register>
+        inline Register shiftLeft(Register bits) noexcept
+        {
+            auto lanes = bitCast<std::array<typename Register::ElementType, Register::SIMDNumElements>>(bits.value);
+
+            for (auto& lane : lanes)
+                lane <<= Shift;
+
+            return Register::fromNative(bitCast<typename Register::vSIMDType>(lanes));
+        }
+
+        template <int Shift, typename Register>
+        inline Register shiftRight(Register bits) noexcept
+        {
+            auto lanes = bitCast<std::array<typename Register::ElementType, Register::SIMDNumElements>>(bits.value);
+
+            for (auto& lane : lanes)
+                lane >>= Shift;
+
+            return Register::fromNative(bitCast<typename Register::vSIMDType>(lanes));
+        }
+    }
+
+    template <typename FloatType>
+    inline juce::dsp::SIMDRegister<FloatType> log2(juce::dsp::SIMDRegister<FloatType> x) noexcept
+    {
+        using Format = detail::Format<FloatType>;
+        using SIMD = detail::SIMD<FloatType>;
+        using SIMDBits = detail::SIMDBits<FloatType>;
+        using Bits = typename Format::Bits;
+
+        constexpr auto mantissaMask = (Bits(1) << Format::mantissaBits) - 1;
+        constexpr auto one = Bits(Format::bias) << Format::mantissaBits;
+
+        // 2^mantissaBits, and its bits
+        constexpr auto magic = FloatType(Bits(1) << Format::mantissaBits);
+        constexpr auto magicBits = Bits(Format::bias + Format::mantissaBits) << Format::mantissaBits;
+
+        const auto bits = detail::toBits(x);
+        const auto exponent = detail::fromBits<FloatType>(detail::shiftRight<Format::mantissaBits>(bits) | SIMDBits::expand(magicBits))
+                            - SIMD::expand(magic + FloatType(Format::bias));
+        const auto t = ((x & SIMDBits::expand(mantissaMask)) | SIMDBits::expand(one)) - SIMD::expand(FloatType(1));
+
+        return exponent + detail::log2Polynomial<FloatType>(t);
+    }
+
+    template <typename FloatType>
+    inline juce::dsp::SIMDRegister<FloatType> exp2(juce::dsp::SIMDRegister<FloatType> x) noexcept
+    {
+        using Format = detail::Format<FloatType>;
+        using SIMD = detail::SIMD<FloatType>;
+        using SIMDBits = detail::SIMDBits<FloatType>;
+        using Bits = typename Format::Bits;
+
+        // 1.5 * 2^mantissaBits, and its bits
+        constexpr auto magic = FloatType(Bits(3) << (Format::mantissaBits - 1));
+        constexpr auto magicBits = (Bits(Format::bias + Format::mantissaBits) << Format::mantissaBits) | (Bits(1) << (Format::mantissaBits - 1));
+
+        x = SIMD::min(SIMD::max(x, SIMD::expand(Format::minExponent)), SIMD::expand(Format::maxExponent));
+
+        const auto shifted = x + SIMD::expand(magic);
+        const auto rounded = shifted - SIMD::expand(magic);
+
+        // floor(): one down where rounding went up, where the mask is all ones, -1 as an integer
+        const auto roundedUp = SIMD::greaterThan(rounded, x);
+        const auto whole = rounded - (SIMD::expand(FloatType(1)) & roundedUp);
+        const auto f = x - whole;
+
+        const auto biasedExponent = detail::toBits(shifted) + roundedUp + SIMDBits::expand(Bits(Format::bias) - magicBits);
+        const auto scale = detail::fromBits<FloatType>(detail::shiftLeft<Format::mantissaBits>(biasedExponent));
+
+        return scale * detail::exp2Polynomial<FloatType>(f);
+    }
+
+    template <typename FloatType>
+    inline juce::dsp::SIMDRegister<FloatType> gainToDecibels(juce::dsp::SIMDRegister<FloatType> gain) noexcept
+    {
+        return log2(gain) * FloatType(6.020599913279624);
+    }
+
+    template <typename FloatType>
+    inline juce::dsp::SIMDRegister<FloatType> decibelsToGain(juce::dsp::SIMDRegister<FloatType> decibels) noexcept
+    {
+        return exp2(decibels * FloatType(0.16609640474436813));
+    }
+   #endif
+
+    namespace detail
+    {
+        // function over whole registers, then over the samples left one by one
+        template <typename FloatType, typename Function>
+        inline void applyToBlock(FloatType* dest, const FloatType* source, int numSamples, Function function) noexcept
+        {
+            auto i = 0;
+
+           #if JUCE_USE_SIMD
+            constexpr auto lanes = (int) SIMD<FloatType>::SIMDNumElements;
+
+            for (; i + lanes <= numSamples; i += lanes)
+                function(SIMD<FloatType>::fromRawArray(source + i)).copyToRawArray(dest + i);
+           #endif
+
+            for (; i < numSamples; ++i)
+                dest[i] = function(source[i]);
+        }
+    }
+
+    // block versions; dest may be the same as source, and both have to be SIMD aligned
+    template <typename FloatType>
+    inline void log2(FloatType* dest, const FloatType* source, int numSamples) noexcept
+    {
+        detail::applyToBlock(dest, source, numSamples, [](auto x) { return log2(x); });
+    }
+
+    template <typename FloatType>
+    inline void exp2(FloatType* dest, const FloatType* source, int numSamples) noexcept
+    {
+        detail::applyToBlock(dest, source, numSamples, [](auto x) { return exp2(x); });
+    }
+
+    template <typename FloatType>
+    inline void gainToDecibels(FloatType* dest, const FloatType* source, int numSamples) noexcept
+    {
+        detail::applyToBlock(dest, source, numSamples, [](auto x) { return gainToDecibels(x); });
+    }
+
+    template <typename FloatType>
+    inline void decibelsToGain(FloatType* dest, const FloatType* source, int numSamples) noexcept
+    {
+        detail::applyToBlock(dest, source, numSamples, [](auto x) { return decibelsToGain(x); });
+    }
+}
+
+// which of the two the gain computers use, same order as the "Precision" parameter
+enum class MathPrecision
+{
+    exact,  // the standard library
+    fast    // FastMath
+};
@@ -0,0 +1,520 @@
+/*
+  ==============================================================================
+
+    Block gain computer for the hat-removal path.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "AlignedBuffer.h"
+#include "ChannelLanes.h"
+#include "FastMath.h"
+#include "LevelDetector.h"
+#include "Lookahead.h"
+
+#include <vector>
+
+enum class DetectorLinkMode
+{
+    unlinked,
+    maximum,    // loudest channel drives all of them
+    average,    // mean level of all channels
+    midSide     // one detector on mid, one on side (stereo only)
+};
+
+/*
+ Works on a whole block at a time instead of one sample per call:
+ 1) level -> dB over the block, the level from a LevelDetector
+ 2) static curve, branch free, in SIMD registers
+ 3) attack/release smoothing, the only recursive (scalar) stage
+ 4) dB -> gain over the block
+ Steps 1 and 4 use the standard library, or FastMath with setPrecision(fast).
+ The standard library loops stay scalar on purpose: neither
+ FloatVectorOperations nor SIMDRegister has a log or exp, and the ones a
+ compiler vectorises to (libmvec, SVML) differ from std::log/std::exp in the
+ last bits from one platform to the next, which would leave Exact no longer
+ the reference that Fast and the golden renders are checked against. Fast is
+ the vectorised path: FastMath's block versions, in SIMDRegisters over the
+ rows, which are aligned for them.
+
+ process() fills one row of gains per channel, getGains() returns the gain to
+ multiply each input sample by. That gain already contains the fixed 50% blend
+ the original per-sample detector applied to its output.
+
+ The detector state is laid out as structure-of-arrays: the gain rows sit back
+ to back in one aligned buffer and the smoothing state is one value per
+ detector, so no channel can touch another's envelope. In the max and average
+ link modes the levels of the linked channels (all but the LFE, usually) are
+ folded into an extra row after the channel rows and the curve runs once;
+ every channel, LFE included, then shares that single row. Unlinked, the
+ smoothing of several detectors runs across channels in SIMD lanes (see
+ ChannelLanes.h).
+ */
+template <typename SampleType>
+class GainComputer
+{
+public:
+    using LinkMode = DetectorLinkMode;
+    using Block = juce::dsp::AudioBlock<SampleType>;
+
+    void prepare(double newSampleRate, int maximumBlockSize, int numChannels, int maximumLookaheadSamples = 0)
+    {
+        maxBlockSize = maximumBlockSize;
+        stride = AlignedBuffer<SampleType>::roundUpToLanes(maximumBlockSize);
+        numPreparedChannels = juce::jmax(1, numChannels);
+        jassert(numPreparedChannels <= maxChannels);
+
+        // the channel rows, then the linked row
+        gains.allocate(stride * (numPreparedChannels + 1));
+        interleaved.allocate(maximumBlockSize * ChannelLanes::lanes<SampleType>);
+        smoothState.allocate(numPreparedChannels + 1);
+        gainRows.assign((size_t) numPreparedChannels, nullptr);
+        window.prepare(numChannels, maximumLookaheadSamples);
+        levelDetector.prepare(numPreparedChannels, newSampleRate);
+
+        setSampleRate(newSampleRate);
+    }
+
+    // doesn't allocate, so the oversampling factor can change on the audio thread
+    void setSampleRate(double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+
+        updateCoefficients();
+        levelDetector.setSampleRate(newSampleRate);
+        reset();
+    }
+
+    void reset()
+    {
+        smoothState.clear();
+        gains.clear();
+        window.reset();
+        levelDetector.reset();
+    }
+
+    // the window the level is taken over; the audio is delayed by the caller
+    void setLookahead(int numSamples)           { window.setLength(numSamples); }
+
+    // the envelopes of one mode mean nothing in another, so they start again
+    void setLinkMode(LinkMode newLinkMode)
+    {
+        if (newLinkMode == linkMode)
+            return;
+
+        linkMode = newLinkMode;
+        smoothState.clear();
+    }
+
+    static constexpr int maxChannels = 32;
+
+    /* Bit n set means channel n feeds the linked detector. Defaults to all of
+       them; if none of the block's channels are set, all of them are used.
+     */
+    void setLinkedChannels(uint32_t newLinkedChannels)  { linkedChannels = newLinkedChannels; }
+
+    // peak by default, see LevelDetector
+    void setDetectorMode(DetectorMode newMode)          { levelDetector.setMode(newMode); }
+    void setRmsWindow(double seconds)                   { levelDetector.setRmsWindow(seconds); }
+
+    // exact by default; the envelopes carry on, the two never differ by more than a hair
+    void setPrecision(MathPrecision newPrecision)       { precision = newPrecision; }
+
+    // on by default; off forces the per-detector smoothing loop, for comparing the two
+    void setChannelLanesEnabled(bool shouldBeEnabled)   { useChannelLanes = shouldBeEnabled; }
+
+    LinkMode getLinkMode() const noexcept       { return linkMode; }
+    MathPrecision getPrecision() const noexcept { return precision; }
+
+    // mid/side only applies to a stereo pair, anything else runs unlinked
+    bool isMidSide(int numChannels) const noexcept
+    {
+        return linkMode == LinkMode::midSide && numChannels == 2;
+    }
+
+    // the setters only recompute the coefficients when the value actually changes
+    void setThreshold(SampleType newThresholdDb)     { setAndUpdate(thresholdDb, newThresholdDb); }
+    void setRatio(SampleType newRatio)               { setAndUpdate(ratio, newRatio); }
+    void setAttack(SampleType newAttackSeconds)      { setAndUpdate(attackSeconds, newAttackSeconds); }
+    void setRelease(SampleType newReleaseSeconds)    { setAndUpdate(releaseSeconds, newReleaseSeconds); }
+
+    int getMaximumBlockSize() const noexcept    { return maxBlockSize; }
+
+    // true once every detector has released back to (within a hair of) 0 dB, i.e. unity gain
+    bool isSettled() const noexcept
+    {
+        for (auto detector = 0; detector <= numPreparedChannels; ++detector)
+            if (std::abs(smoothState.get()[detector]) > settledDb)
+                return false;
+
+        return true;
+    }
+
+    /* The block must not be longer than the size given to prepare(). With
+       lookahead on, the level is the window peak, and the gains line up with
+       the block as it comes out of a delay of the same length, which is the
+       caller's. In mid/side mode the caller encodes the block first (see
+       encodeMidSide) and the two rows are the mid and side gains.
+     */
+    void process(const Block& block)
+    {
+        const auto numChannels = (int) block.getNumChannels();
+        const auto numSamples = (int) block.getNumSamples();
+
+        jassert(numSamples <= maxBlockSize && numChannels <= numPreparedChannels);
+
+        for (auto channel = 0; channel < numChannels; ++channel)
+            detect(channel, block.getChannelPointer((size_t) channel), numSamples);
+
+        computeGains(numChannels, numSamples);
+    }
+
+    /* process() in two halves, for a caller that produces the audio one sample
+       at a time anyway: detectSample() for every sample of every channel, in
+       order, then computeGains() for the block. With lookahead, `input` is the
+       audio `lookahead` samples ahead of the samples the gains will go on.
+     */
+    void detectSample(int channel, int index, SampleType input) noexcept
+    {
+        getRow(channel)[index] = window.process(channel, levelDetector.process(channel, input));
+    }
+
+    void computeGains(int numChannels, int numSamples)
+    {
+        ChannelLanes::withChannelCount(numChannels, [&](auto channelCount)
+        {
+            computeGains<decltype(channelCount)::value>(numChannels, numSamples);
+        });
+    }
+
+    const SampleType* getGains(int channel) const noexcept
+    {
+        return getRow(linked ? getLinkedRow() : channel);
+    }
+
+    // getGains() for every channel of the last block, as one array
+    const SampleType* const* getGainRows() const noexcept    { return gainRows.data(); }
+
+    // the lowest gain of the last block across its channels, for the meters
+    SampleType getMinimumGain(int numChannels, int numSamples) const noexcept
+    {
+        auto minimum = SampleType(1);
+
+        for (auto channel = 0; channel < numChannels; ++channel)
+            minimum = juce::jmin(minimum, juce::FloatVectorOperations::findMinimum(gainRows[(size_t) channel], numSamples));
+
+        return minimum;
+    }
+
+    // (L, R) -> (M, S) and back, in place; decode(encode(x)) == x
+    static void encodeMidSide(SampleType* left, SampleType* right, int numSamples) noexcept
+    {
+        for (auto i = 0; i < numSamples; ++i)
+        {
+            const auto mid = SampleType(0.5) * (left[i] + right[i]);
+            const auto side = SampleType(0.5) * (left[i] - right[i]);
+            left[i] = mid;
+            right[i] = side;
+        }
+    }
+
+    static void decodeMidSide(SampleType* mid, SampleType* side, int numSamples) noexcept
+    {
+        for (auto i = 0; i < numSamples; ++i)
+        {
+            const auto left = mid[i] + side[i];
+            const auto right = mid[i] - side[i];
+            mid[i] = left;
+            side[i] = right;
+        }
+    }
+
+private:
+    static constexpr SampleType floorDb = SampleType(-96);
+    static constexpr SampleType settledDb = SampleType(0.001);
+    static constexpr SampleType blend = SampleType(0.5);
+    static constexpr SampleType ln10 = SampleType(2.302585092994046);
+
+    SampleType* getRow(int channel) const noexcept   { return gains.get() + channel * stride; }
+    int getLinkedRow() const noexcept           { return numPreparedChannels; }
+
+    // NumChannels == 0 is the generic version, see ChannelLanes::withChannelCount
+    template <int NumChannels>
+    void computeGains(int blockChannels, int numSamples)
+    {
+        const auto numChannels = ChannelLanes::resolve<NumChannels>(blockChannels);
+
+        linked = numChannels > 1 && (linkMode == LinkMode::maximum || linkMode == LinkMode::average);
+
+        if (linked)
+        {
+            foldChannels(numChannels, numSamples);
+            runDetector(getLinkedRow(), numSamples, true);
+        }
+        else
+        {
+            const auto smoothAcross = ChannelLanes::isAvailable<SampleType>() && useChannelLanes && numChannels > 1;
+
+            for (auto channel = 0; channel < numChannels; ++channel)
+                runDetector(channel, numSamples, ! smoothAcross);
+
+            if (smoothAcross)
+            {
+                smoothAcrossChannels(numChannels, numSamples);
+
+                for (auto channel = 0; channel < numChannels; ++channel)
+                    convertToGain(getRow(channel), numSamples);
+            }
+        }
+
+        for (auto channel = 0; channel < numChannels; ++channel)
+            gainRows[(size_t) channel] = getGains(channel);
+    }
+
+    // level -> gain for one row; without `complete` it stops before the smoothing
+    void runDetector(int row, int numSamples, bool complete)
+    {
+        auto* levels = getRow(row);
+
+        computeLevels(levels, numSamples);
+        applyStaticCurve(levels, numSamples);
+
+        if (complete)
+        {
+            smooth(smoothState.get()[row], levels, numSamples);
+            convertToGain(levels, numSamples);
+        }
+    }
+
+    // the level, or its lookahead window peak, into the channel's row
+    void detect(int channel, const SampleType* data, int numSamples)
+    {
+        auto* row = getRow(channel);
+
+        if (window.getLength() > 0)
+        {
+            for (auto i = 0; i < numSamples; ++i)
+                row[i] = window.process(channel, levelDetector.process(channel, data[i]));
+        }
+        else if (levelDetector.getMode() == DetectorMode::peak)
+        {
+            juce::FloatVectorOperations::abs(row, data, numSamples);
+        }
+        else
+        {
+            for (auto i = 0; i < numSamples; ++i)
+                row[i] = levelDetector.process(channel, data[i]);
+        }
+    }
+
+    // combines the linked channels' levels into the linked row
+    void foldChannels(int numChannels, int numSamples)
+    {
+        const auto present = numChannels >= 32 ? ~0u : (1u << numChannels) - 1u;
+        auto mask = linkedChannels & present;
+
+        if (mask == 0)
+            mask = present;
+
+        auto* destination = getRow(getLinkedRow());
+        auto numFolded = 0;
+
+        for (auto channel = 0; channel < numChannels; ++channel)
+        {
+            if ((mask & (1u << channel)) == 0)
+                continue;
+
+            if (numFolded++ == 0)
+                juce::FloatVectorOperations::copy(destination, getRow(channel), numSamples);
+            else if (linkMode == LinkMode::maximum)
+                juce::FloatVectorOperations::max(destination, destination, getRow(channel), numSamples);
+            else
+                juce::FloatVectorOperations::add(destination, getRow(channel), numSamples);
+        }
+
+        if (linkMode == LinkMode::average)
+            juce::FloatVectorOperations::multiply(destination, SampleType(1) / (SampleType) numFolded, numSamples);
+    }
+
+    void setAndUpdate(SampleType& value, SampleType newValue)
+    {
+        if (value == newValue)
+            return;
+
+        value = newValue;
+        updateCoefficients();
+    }
+
+    void updateCoefficients()
+    {
+        alphaAttack = calculateAlpha(attackSeconds);
+        alphaRelease = calculateAlpha(releaseSeconds);
+
+        // above the threshold: gainSC = T + (x - T) / R, so the change is (x - T) * (1/R - 1)
+        slope = SampleType(1) / ratio - SampleType(1);
+    }
+
+    SampleType calculateAlpha(SampleType seconds) const
+    {
+        if (seconds <= 0 || sampleRate <= 0.0)
+            return 0; // immediate
+
+        return (SampleType) std::exp(-std::log(9.0) / (sampleRate * seconds));
+    }
+
+    // |x| -> dB, in place
+    void computeLevels(SampleType* dest, int numSamples) const
+    {
+        const auto floorGain = juce::Decibels::decibelsToGain(floorDb);
+        constexpr auto toDecibels = SampleType(20) / ln10;
+
+        juce::FloatVectorOperations::max(dest, dest, floorGain, numSamples);
+
+        if (precision == MathPrecision::fast)
+        {
+            FastMath::gainToDecibels(dest, dest, numSamples);
+            return;
+        }
+
+        // scalar, see the class comment
+        for (auto i = 0; i < numSamples; ++i)
+            dest[i] = std::log(dest[i]);
+
+        juce::FloatVectorOperations::multiply(dest, toDecibels, numSamples);
+    }
+
+    void applyStaticCurve(SampleType* levelsDb, int numSamples) const
+    {
+       #if JUCE_USE_SIMD
+        using SIMD = juce::dsp::SIMDRegister<SampleType>;
+
+        const auto threshold = SIMD::expand(thresholdDb);
+        const auto zero = SIMD::expand(SampleType(0));
+        const auto curveSlope = SIMD::expand(slope);
+        auto numVectors = AlignedBuffer<SampleType>::roundUpToLanes(numSamples) / (int) SIMD::SIMDNumElements;
+
+        for (auto v = 0; v < numVectors; ++v)
+        {
+            auto* ptr = levelsDb + v * (int) SIMD::SIMDNumElements;
+            auto x = SIMD::fromRawArray(ptr);
+            (SIMD::max(x - threshold, zero) * curveSlope).copyToRawArray(ptr);
+        }
+       #else
+        for (auto i = 0; i < numSamples; ++i)
+            levelsDb[i] = juce::jmax(levelsDb[i] - thresholdDb, SampleType(0)) * slope;
+       #endif
+    }
+
+    void smooth(SampleType& state, SampleType* gainChangeDb, int numSamples) const
+    {
+        auto previous = state;
+
+        for (auto i = 0; i < numSamples; ++i)
+        {
+            const auto gainChange = gainChangeDb[i];
+            const auto alpha = gainChange < previous ? alphaAttack : alphaRelease;
+
+            previous = (SampleType(1) - alpha) * gainChange + alpha * previous;
+            gainChangeDb[i] = previous;
+        }
+
+        state = previous;
+    }
+
+    // smooth(), with one detector per lane
+    void smoothAcrossChannels(int numDetectors, int numSamples) noexcept
+    {
+       #if JUCE_USE_SIMD
+        using SIMD = juce::dsp::SIMDRegister<SampleType>;
+        constexpr auto lanes = ChannelLanes::lanes<SampleType>;
+
+        const auto attackMinusRelease = SIMD::expand(alphaAttack - alphaRelease);
+        const auto release = SIMD::expand(alphaRelease);
+        const auto one = SIMD::expand(SampleType(1));
+
+        for (auto first = 0; first < numDetectors; first += lanes)
+        {
+            const auto count = juce::jmin(lanes, numDetectors - first);
+            SampleType* rows[lanes] {};
+
+            for (auto lane = 0; lane < count; ++lane)
+                rows[lane] = getRow(first + lane);
+
+            ChannelLanes::interleave(rows, count, interleaved.get(), numSamples);
+
+            auto previous = SIMD::fromRawArray(smoothState.get() + first);
+
+            for (auto i = 0; i < numSamples; ++i)
+            {
+                auto* frame = interleaved.get() + i * lanes;
+                const auto gainChange = SIMD::fromRawArray(frame);
+
+                // attack where the gain is falling, release elsewhere
+                const auto alpha = release + (attackMinusRelease & SIMD::lessThan(gainChange, previous));
+
+                previous = (one - alpha) * gainChange + alpha * previous;
+                previous.copyToRawArray(frame);
+            }
+
+            previous.copyToRawArray(smoothState.get() + first);
+
+            ChannelLanes::deinterleave(interleaved.get(), rows, count, numSamples);
+        }
+       #else
+        for (auto detector = 0; detector < numDetectors; ++detector)
+            smooth(smoothState.get()[detector], getRow(detector), numSamples);
+       #endif
+    }
+
+    void convertToGain(SampleType* gainDb, int numSamples) const
+    {
+        constexpr auto toNepers = ln10 / SampleType(20);
+
+        if (precision == MathPrecision::fast)
+        {
+            FastMath::decibelsToGain(gainDb, gainDb, numSamples);
+        }
+        else
+        {
+            // scalar like computeLevels()
+            for (auto i = 0; i < numSamples; ++i)
+                gainDb[i] = std::exp(gainDb[i] * toNepers);
+        }
+
+        // (1 - blend) * x + blend * x * gain
+        juce::FloatVectorOperations::multiply(gainDb, blend, numSamples);
+        juce::FloatVectorOperations::add(gainDb, SampleType(1) - blend, numSamples);
+    }
+
+    double sampleRate = 48000.0;
+    int maxBlockSize = 0;
+    int stride = 0;
+    int numPreparedChannels = 0;
+
+    // defaults are the values the original per-sample detector hardcoded
+    SampleType thresholdDb = SampleType(-50);
+    SampleType ratio = SampleType(-30);
+    SampleType attackSeconds = 0;
+    SampleType releaseSeconds = SampleType(0.1);
+
+    SampleType alphaAttack = 0;
+    SampleType alphaRelease = 0;
+    SampleType slope = 0;
+
+    LinkMode linkMode = LinkMode::unlinked;
+    MathPrecision precision = MathPrecision::exact;
+    bool linked = false;
+    bool useChannelLanes = true;
+    uint32_t linkedChannels = ~0u;
+
+    // structure-of-arrays: one gain row per channel, one smoothing state per detector
+    AlignedBuffer<SampleType> gains;
+    AlignedBuffer<SampleType> smoothState;
+    AlignedBuffer<SampleType> interleaved;
+    std::vector<const SampleType*> gainRows;
+    WindowPeak<SampleType> window;
+    LevelDetector<SampleType> levelDetector;
+};
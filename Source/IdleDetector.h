@@ -0,0 +1,99 @@
+/*
+  ==============================================================================
+
+    Decides when the DSP can be skipped because nothing would come out of it.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+#include <limits>
+
+/*
+ A track that is silent most of the time still pays for the whole chain on every
+ block. The processor goes idle, and only clears its output, once
+ - the input has stayed under the noise floor long enough to have flushed the
+   lookahead and oversampler delays and let the recursive filters ring out,
+ - the last processed block came out under the noise floor too, and
+ - every envelope has released back to unity gain.
+ It then resets the chain, so the first loud block after that starts from the
+ same all-zero state a fresh instance would, with the lookahead still in front
+ of it: no click going in, none coming out.
+
+ Everything but the atomics belongs to the audio thread.
+ */
+class IdleDetector
+{
+public:
+    static constexpr float floorDb = -100.0f;
+    static constexpr double floorGain = 1.0e-5; // floorDb as a gain, a constant so nothing is initialised on the audio thread
+    static constexpr double decaySeconds = 0.1; // ring-out of the crossover and allpass at their lowest corners
+
+    void prepare(double sampleRate)
+    {
+        decaySamples = juce::roundToInt(decaySeconds * sampleRate);
+        reset();
+    }
+
+    void reset()
+    {
+        silentSamples = 0;
+        setIdle(false);
+    }
+
+    // for the tools, to measure what skipping saves
+    void setEnabled(bool shouldBeEnabled)       { enabled.store(shouldBeEnabled, std::memory_order_relaxed); }
+    bool isEnabled() const noexcept             { return enabled.load(std::memory_order_relaxed); }
+
+    // safe from any thread: for the meters, and for hosts polling the tail
+    bool isIdle() const noexcept                { return reportedIdle.load(std::memory_order_relaxed); }
+
+    int getDecaySamples() const noexcept        { return decaySamples; }
+
+    template <typename SampleType>
+    static bool isSilent(const juce::AudioBuffer<SampleType>& buffer)
+    {
+        return buffer.getMagnitude(0, buffer.getNumSamples()) < (SampleType) floorGain;
+    }
+
+    // called before processing; true means the block can be cleared instead
+    bool canSkip(bool inputIsSilent, int numSamples) noexcept
+    {
+        if (! inputIsSilent)
+        {
+            silentSamples = 0;
+            setIdle(false);
+            return false;
+        }
+
+        silentSamples = juce::jmin(silentSamples + numSamples, std::numeric_limits<int>::max() / 2);
+        return idle;
+    }
+
+    // whether the input has been silent long enough for the delays to have emptied
+    bool hasHeldFor(int latencySamples) const noexcept
+    {
+        return silentSamples >= latencySamples + decaySamples;
+    }
+
+    // the caller has reset the chain
+    void enterIdle() noexcept                   { setIdle(true); }
+
+private:
+    void setIdle(bool isNowIdle) noexcept
+    {
+        idle = isNowIdle;
+        reportedIdle.store(isNowIdle, std::memory_order_relaxed);
+    }
+
+    int decaySamples = 0;
+    int silentSamples = 0;
+    bool idle = false;
+
+    std::atomic<bool> enabled { true };
+    std::atomic<bool> reportedIdle { false };
+};
@@ -0,0 +1,263 @@
+/*
+  ==============================================================================
+
+    Per-sample level for the gain computer: peak, windowed RMS or true peak.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <array>
+#include <vector>
+
+// same order as the "Detector" parameter
+enum class DetectorMode
+{
+    peak,       // |x|, what the detector always used
+    rms,        // root mean square over the last window
+    truePeak    // the peak between the samples too, from a 4x interpolation
+};
+
+/*
+ Turns each input sample into the level the static curve works on.
+
+ RMS keeps the squares in a ring as long as the longest window and a running
+ sum of the last window of them, so a sample costs the same whatever the
+ window length. Adding and subtracting would let rounding errors pile up in
+ the sum over a long session; instead a second sum collects the squares
+ written since it was last taken, and once it holds exactly a window it
+ replaces the running one. The ring outlives a change of window: the sum is
+ rebuilt from the squares already in it, so an automated window doesn't drop
+ the level to nothing on every change.
+
+ True peak runs the input through a 4x polyphase interpolator, 12 taps per
+ phase as in ITU-R BS.1770, and takes the largest of the four interpolated
+ values. Only the taps each phase needs are computed, nothing is run at the
+ 4x rate. A sine reads at most 0.45 dB under its true peak up to 0.45 of the
+ sample rate, and 0.17 dB below a quarter of it, most of that the 4x grid
+ missing the crest. The interpolator delays the level by half its length,
+ truePeakLatency samples; with lookahead at least that long it still arrives
+ in time, so the processor never runs true peak with less.
+
+ Everything is allocated in prepare(), for the longest window at the highest
+ rate; the rest doesn't allocate.
+ */
+template <typename SampleType>
+class LevelDetector
+{
+public:
+    static constexpr double maxRmsWindowSeconds = 0.05;
+
+    // how far the true-peak level lags the input, half the interpolator, rounded up
+    static constexpr int truePeakLatency = 6;
+
+    void prepare(int numChannels, double maximumSampleRate)
+    {
+        capacity = juce::jmax(1, (int) std::ceil(maxRmsWindowSeconds * maximumSampleRate));
+        channels.resize((size_t) numChannels);
+
+        for (auto& c : channels)
+            c.squares.assign((size_t) capacity, SampleType(0));
+
+        designInterpolator();
+        setSampleRate(maximumSampleRate);
+    }
+
+    void setSampleRate(double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+        updateWindowLength();
+        reset();
+    }
+
+    void reset()
+    {
+        for (auto& c : channels)
+        {
+            std::fill(c.squares.begin(), c.squares.end(), SampleType(0));
+            c.history.fill(SampleType(0));
+            c.sum = c.nextSum = 0.0;
+            c.position = c.sincePublished = c.historyPosition = 0;
+        }
+    }
+
+    // the window of one mode means nothing to another, so a change starts afresh
+    void setMode(DetectorMode newMode)
+    {
+        if (newMode == mode)
+            return;
+
+        mode = newMode;
+        reset();
+    }
+
+    void setRmsWindow(double seconds)
+    {
+        if (seconds == windowSeconds)
+            return;
+
+        windowSeconds = seconds;
+
+        const auto previousLength = windowLength;
+        updateWindowLength();
+
+        if (windowLength != previousLength)
+            rebuildSums();
+    }
+
+    DetectorMode getMode() const noexcept       { return mode; }
+
+    SampleType process(int channel, SampleType input) noexcept
+    {
+        switch (mode)
+        {
+            case DetectorMode::rms:         return processRms(channels[(size_t) channel], input);
+            case DetectorMode::truePeak:    return processTruePeak(channels[(size_t) channel], input);
+            case DetectorMode::peak:
+            default:                        return std::abs(input);
+        }
+    }
+
+private:
+    static constexpr int factor = 4;
+    static constexpr int tapsPerPhase = 12;
+    static_assert(truePeakLatency * 2 >= tapsPerPhase - 1, "truePeakLatency must cover the interpolator's delay");
+
+    struct Channel
+    {
+        std::vector<SampleType> squares;
+        double sum = 0.0, nextSum = 0.0;
+        int position = 0, sincePublished = 0;
+
+        // the last tapsPerPhase inputs, twice over, so they can always be read in one run
+        std::array<SampleType, 2 * tapsPerPhase> history {};
+        int historyPosition = 0;
+    };
+
+    SampleType processRms(Channel& c, SampleType input) noexcept
+    {
+        // the square as it is stored, so exactly the amount added now is taken off later
+        const auto square = input * input;
+
+        c.sum += (double) square - (double) c.squares[(size_t) oldestPosition(c)];
+        c.nextSum += (double) square;
+        c.squares[(size_t) c.position] = square;
+
+        if (++c.position == capacity)
+            c.position = 0;
+
+        if (++c.sincePublished == windowLength)
+        {
+            c.sincePublished = 0;
+            c.sum = c.nextSum;
+            c.nextSum = 0.0;
+        }
+
+        return (SampleType) std::sqrt(juce::jmax(0.0, c.sum) * inverseWindowLength);
+    }
+
+    SampleType processTruePeak(Channel& c, SampleType input) noexcept
+    {
+        c.history[(size_t) c.historyPosition] = input;
+        c.history[(size_t) (c.historyPosition + tapsPerPhase)] = input;
+
+        if (++c.historyPosition == tapsPerPhase)
+            c.historyPosition = 0;
+
+        // oldest to newest
+        const auto* window = c.history.data() + c.historyPosition;
+        auto peak = SampleType(0);
+
+        for (auto& taps : phases)
+        {
+            auto value = SampleType(0);
+
+            for (auto tap = 0; tap < tapsPerPhase; ++tap)
+                value += taps[(size_t) tap] * window[tap];
+
+            peak = juce::jmax(peak, std::abs(value));
+        }
+
+        return peak;
+    }
+
+    /* A Kaiser windowed sinc at the 4x rate, cut off at the input's Nyquist,
+       split into its four phases. Each phase is normalised to unity at DC, so
+       a constant reads the same in every one, and stored oldest tap first to
+       match the history.
+     */
+    void designInterpolator()
+    {
+        constexpr auto length = factor * tapsPerPhase;
+        std::array<double, length> prototype;
+
+        juce::dsp::WindowingFunction<double>::fillWindowingTables(prototype.data(), (size_t) length,
+                                                                  juce::dsp::WindowingFunction<double>::kaiser, false, 4.0);
+
+        // an even length has no middle tap, so the sinc is never taken at 0
+        for (auto i = 0; i < length; ++i)
+        {
+            const auto x = juce::MathConstants<double>::pi * ((double) i - 0.5 * (length - 1)) / factor;
+            prototype[(size_t) i] *= std::sin(x) / x;
+        }
+
+        for (auto phase = 0; phase < factor; ++phase)
+        {
+            auto sum = 0.0;
+
+            for (auto tap = 0; tap < tapsPerPhase; ++tap)
+                sum += prototype[(size_t) (phase + factor * tap)];
+
+            for (auto tap = 0; tap < tapsPerPhase; ++tap)
+                phases[(size_t) phase][(size_t) (tapsPerPhase - 1 - tap)] = (SampleType) (prototype[(size_t) (phase + factor * tap)] / sum);
+        }
+    }
+
+    // where the square leaving the window sits, windowLength before the next write
+    int oldestPosition(const Channel& c) const noexcept
+    {
+        const auto position = c.position - windowLength;
+        return position < 0 ? position + capacity : position;
+    }
+
+    // the running sum for a new window length, from the squares the ring already holds
+    void rebuildSums() noexcept
+    {
+        for (auto& c : channels)
+        {
+            auto sum = 0.0;
+            auto position = oldestPosition(c);
+
+            for (auto i = 0; i < windowLength; ++i)
+            {
+                sum += (double) c.squares[(size_t) position];
+
+                if (++position == capacity)
+                    position = 0;
+            }
+
+            c.sum = sum;
+            c.nextSum = 0.0;
+            c.sincePublished = 0;
+        }
+    }
+
+    void updateWindowLength()
+    {
+        windowLength = juce::jlimit(1, capacity, juce::roundToInt(windowSeconds * sampleRate));
+        inverseWindowLength = 1.0 / (double) windowLength;
+    }
+
+    std::vector<Channel> channels;
+    std::array<std::array<SampleType, tapsPerPhase>, factor> phases {};
+
+    DetectorMode mode = DetectorMode::peak;
+    double sampleRate = 48000.0;
+    double windowSeconds = 0.01;
+    int capacity = 1;
+    int windowLength = 1;
+    double inverseWindowLength = 1.0;
+};
@@ -0,0 +1,228 @@
+/*
+  ==============================================================================
+
+    Lookahead delay, and an O(1) sliding-window peak for the detectors.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+/*
+ Gives, for every sample, the peak of |x|, or of a level the caller worked
+ out, over the `length` + 1 most recent inputs. A detector fed with that peak
+ while the audio goes through a LookaheadDelay of the same length sees a
+ transient `length` samples before the delayed audio reaches the gain stage,
+ which is the point of the exercise.
+
+ The peak comes from a monotonic deque: each input is pushed once and popped at
+ most once, so a sample costs amortised O(1) whatever the window length.
+ Everything is allocated in prepare(); the ring sizes are powers of two so the
+ indices wrap with a mask.
+ */
+template <typename SampleType>
+class WindowPeak
+{
+public:
+    void prepare(int numChannels, int maximumLength)
+    {
+        const auto capacity = juce::nextPowerOfTwo(juce::jmax(1, maximumLength + 1));
+        mask = (uint32_t) capacity - 1;
+        maxLength = maximumLength;
+
+        channels.resize((size_t) numChannels);
+
+        for (auto& c : channels)
+        {
+            c.peakValues.assign((size_t) capacity, SampleType(0));
+            c.peakTimes.assign((size_t) capacity, 0);
+        }
+
+        length = juce::jmin(length, maxLength);
+        reset();
+    }
+
+    void reset()
+    {
+        for (auto& c : channels)
+            c.time = c.head = c.tail = 0;
+    }
+
+    // the deque only holds what is still in the window, so it follows a new length as it is
+    void setLength(int newLength)
+    {
+        length = juce::jlimit(0, maxLength, newLength);
+    }
+
+    int getLength() const noexcept          { return length; }
+
+    // forgets the window, for a caller that stopped feeding it for a while
+    void clear() noexcept
+    {
+        for (auto& c : channels)
+            c.head = c.tail;
+    }
+
+    SampleType process(int channel, SampleType level) noexcept
+    {
+        if (length == 0)
+            return level;
+
+        auto& c = channels[(size_t) channel];
+
+        // drop the front once it is older than the window; doing it before the
+        // push keeps the deque at length + 1 entries, which the ring holds
+        while (c.tail != c.head && c.time - c.peakTimes[c.head & mask] > (uint32_t) length)
+            ++c.head;
+
+        // drop everything the new sample dominates, it can never be the maximum again
+        while (c.tail != c.head && c.peakValues[(c.tail - 1) & mask] <= level)
+            --c.tail;
+
+        c.peakValues[c.tail & mask] = level;
+        c.peakTimes[c.tail & mask] = c.time;
+        ++c.tail;
+        ++c.time;
+
+        return c.peakValues[c.head & mask];
+    }
+
+private:
+    struct Channel
+    {
+        std::vector<SampleType> peakValues;
+        std::vector<uint32_t> peakTimes;
+
+        // free running counters, only ever used masked or as differences
+        uint32_t time = 0;
+        uint32_t head = 0, tail = 0;
+    };
+
+    std::vector<Channel> channels;
+    uint32_t mask = 0;
+    int maxLength = 0;
+    int length = 0;
+};
+
+/*
+ Delays frames of NumValues samples per channel, the three bands of the
+ crossover for the processor, by `lookahead` samples. One line for all of
+ them, so the audio is delayed once however many detectors look ahead.
+
+ A new length doesn't clear the line: the line keeps being written whatever
+ the length, so the new tap already holds the right audio, and the output
+ crossfades from the old tap to it over fadeSeconds. A length set while a
+ fade is running waits for it to finish; fades start at startBlock().
+ */
+template <typename SampleType, int NumValues>
+class LookaheadDelay
+{
+public:
+    static constexpr double fadeSeconds = 0.01;
+
+    void prepare(double sampleRate, int numChannels, int maximumLookaheadSamples)
+    {
+        const auto capacity = juce::nextPowerOfTwo(juce::jmax(1, maximumLookaheadSamples + 1));
+        mask = (uint32_t) capacity - 1;
+        maxLookahead = maximumLookaheadSamples;
+
+        channels.resize((size_t) numChannels);
+
+        for (auto& c : channels)
+            c.frames.assign((size_t) (capacity * NumValues), SampleType(0));
+
+        targetLookahead = juce::jmin(targetLookahead, maxLookahead);
+        setSampleRate(sampleRate);
+    }
+
+    // doesn't allocate, so the oversampling factor can change on the audio thread
+    void setSampleRate(double sampleRate)
+    {
+        fadeLength = juce::jmax(1, juce::roundToInt(fadeSeconds * sampleRate));
+        reset();
+    }
+
+    // an empty line has nothing to fade from, so a waiting length applies at once
+    void reset()
+    {
+        lookahead = previousLookahead = targetLookahead;
+
+        for (auto& c : channels)
+        {
+            std::fill(c.frames.begin(), c.frames.end(), SampleType(0));
+            c.writePosition = 0;
+            c.fadeRemaining = 0;
+        }
+    }
+
+    void setLookahead(int newLookaheadSamples)
+    {
+        targetLookahead = juce::jlimit(0, maxLookahead, newLookaheadSamples);
+    }
+
+    // the length the line is at or fading to
+    int getLookahead() const noexcept       { return lookahead; }
+
+    // before the process() calls for a block; starts the fade to a new length
+    void startBlock() noexcept
+    {
+        if (targetLookahead == lookahead || channels.empty() || channels.front().fadeRemaining > 0)
+            return;
+
+        previousLookahead = std::exchange(lookahead, targetLookahead);
+
+        for (auto& c : channels)
+            c.fadeRemaining = fadeLength;
+    }
+
+    // writes `input` into the line and the frame from `lookahead` samples ago into `output`
+    void process(int channel, const SampleType* input, SampleType* output) noexcept
+    {
+        auto& c = channels[(size_t) channel];
+
+        std::copy(input, input + NumValues, frameAt(c, c.writePosition));
+
+        const auto* delayed = frameAt(c, c.writePosition - (uint32_t) lookahead);
+
+        if (c.fadeRemaining == 0)
+        {
+            std::copy(delayed, delayed + NumValues, output);
+        }
+        else
+        {
+            // what is left of the old tap, down to nothing
+            const auto* previous = frameAt(c, c.writePosition - (uint32_t) previousLookahead);
+            const auto weight = (SampleType) c.fadeRemaining-- / (SampleType) (fadeLength + 1);
+
+            for (auto i = 0; i < NumValues; ++i)
+                output[i] = delayed[i] + weight * (previous[i] - delayed[i]);
+        }
+
+        ++c.writePosition;
+    }
+
+private:
+    struct Channel
+    {
+        std::vector<SampleType> frames;
+        uint32_t writePosition = 0;   // free running, only ever used masked
+        int fadeRemaining = 0;
+    };
+
+    SampleType* frameAt(Channel& c, uint32_t position) const noexcept
+    {
+        return c.frames.data() + (position & mask) * NumValues;
+    }
+
+    std::vector<Channel> channels;
+    uint32_t mask = 0;
+    int maxLookahead = 0;
+    int lookahead = 0, previousLookahead = 0, targetLookahead = 0;
+    int fadeLength = 1;
+};
@@ -0,0 +1,167 @@
+/*
+  ==============================================================================
+
+    Meter values from the audio thread to the editor.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+/*
+ One meter update, covering about 10 ms of audio. Levels are linear and taken
+ from the loudest channel; gain reductions are positive dB.
+ */
+struct MeterFrame
+{
+    float inputPeak = 0.0f;
+    float inputRms = 0.0f;
+    float outputPeak = 0.0f;
+    float outputRms = 0.0f;
+    std::array<float, 3> bandGainReductionDb {};
+    float hatGainReductionDb = 0.0f;   // the gain computer in front of the allpass
+    bool idle = false;
+};
+
+/*
+ Single producer (the audio thread), single consumer (the editor's timer).
+ Neither side ever waits for the other: push() on a full FIFO drops the frame,
+ which only happens when nobody is reading, and pop() on an empty one returns
+ nothing. The frames live in a fixed array, so pushing never allocates.
+ */
+class MeterFifo
+{
+public:
+    static constexpr int capacity = 256; // 2.5 s of frames
+
+    bool push(const MeterFrame& frame) noexcept
+    {
+        const auto scope = fifo.write(1);
+
+        if (scope.blockSize1 == 0)
+            return false;
+
+        frames[(size_t) scope.startIndex1] = frame;
+        return true;
+    }
+
+    // calls handleFrame(const MeterFrame&) for everything pushed so far, oldest first
+    template <typename Callback>
+    int popAll(Callback&& handleFrame)
+    {
+        const auto scope = fifo.read(fifo.getNumReady());
+
+        for (auto i = 0; i < scope.blockSize1; ++i)
+            handleFrame(frames[(size_t) (scope.startIndex1 + i)]);
+
+        for (auto i = 0; i < scope.blockSize2; ++i)
+            handleFrame(frames[(size_t) (scope.startIndex2 + i)]);
+
+        return scope.blockSize1 + scope.blockSize2;
+    }
+
+private:
+    juce::AbstractFifo fifo { capacity + 1 };
+    std::array<MeterFrame, capacity + 1> frames;
+};
+
+/*
+ Folds the host's blocks, whatever their size, into frames of a fixed length
+ and pushes each one to the FIFO when it's complete. Audio thread only.
+ */
+class MeterCollector
+{
+public:
+    static constexpr double framesPerSecond = 100.0;
+    static constexpr int maxChannels = 32;
+
+    void prepare(double sampleRate)
+    {
+        frameLength = juce::jmax(1, juce::roundToInt(sampleRate / framesPerSecond));
+        reset();
+    }
+
+    void reset()
+    {
+        frame = {};
+        inputSquares.fill(0.0);
+        outputSquares.fill(0.0);
+        numSamples = 0;
+    }
+
+    template <typename SampleType>
+    void addInput(const juce::AudioBuffer<SampleType>& buffer)
+    {
+        measure(buffer, frame.inputPeak, inputSquares);
+    }
+
+    template <typename SampleType>
+    void addOutput(const juce::AudioBuffer<SampleType>& buffer)
+    {
+        measure(buffer, frame.outputPeak, outputSquares);
+    }
+
+    // gains are linear, the lowest one of the frame is what the meter shows
+    void addBandGain(size_t band, float gain)
+    {
+        frame.bandGainReductionDb[band] = juce::jmax(frame.bandGainReductionDb[band], toReductionDb(gain));
+    }
+
+    void addHatGain(float gain)
+    {
+        frame.hatGainReductionDb = juce::jmax(frame.hatGainReductionDb, toReductionDb(gain));
+    }
+
+    void finishBlock(MeterFifo& fifo, int blockLength, bool idle)
+    {
+        frame.idle = idle;
+        numSamples += blockLength;
+
+        if (numSamples < frameLength)
+            return;
+
+        frame.inputRms = getLoudestRms(inputSquares);
+        frame.outputRms = getLoudestRms(outputSquares);
+
+        fifo.push(frame);
+        reset();
+    }
+
+private:
+    static float toReductionDb(float gain)
+    {
+        return -juce::Decibels::gainToDecibels(gain, -100.0f);
+    }
+
+    template <typename SampleType>
+    static void measure(const juce::AudioBuffer<SampleType>& buffer, float& peak, std::array<double, maxChannels>& squares)
+    {
+        const auto numChannels = juce::jmin(buffer.getNumChannels(), maxChannels);
+        const auto length = buffer.getNumSamples();
+
+        for (auto channel = 0; channel < numChannels; ++channel)
+        {
+            const auto rms = (double) buffer.getRMSLevel(channel, 0, length);
+
+            peak = juce::jmax(peak, (float) buffer.getMagnitude(channel, 0, length));
+            squares[(size_t) channel] += rms * rms * length;
+        }
+    }
+
+    float getLoudestRms(const std::array<double, maxChannels>& squares) const
+    {
+        const auto loudest = *std::max_element(squares.begin(), squares.end());
+        return (float) std::sqrt(loudest / juce::jmax(1, numSamples));
+    }
+
+    MeterFrame frame;
+    std::array<double, maxChannels> inputSquares {}, outputSquares {};
+    int frameLength = 480;
+    int numSamples = 0;
+};
@@ -0,0 +1,201 @@
+/*
+  ==============================================================================
+
+    Per-block copy of the plugin parameters.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <array>
+
+/*
+ processBlock reads every APVTS atomic exactly once, into a ParameterSnapshot,
+ at the top of the block. The snapshot is compared with the one that was last
+ applied, and only the stages whose inputs differ recompute their coefficients.
+ */
+struct BandParameters
+{
+    float thresholdDb = 0.0f;
+    float attackMs = 0.0f;
+    float releaseMs = 0.0f;
+    float ratio = 1.0f;
+    bool bypassed = false;
+    bool muted = false;
+    bool soloed = false;
+
+    bool operator==(const BandParameters& other) const noexcept
+    {
+        return thresholdDb == other.thresholdDb
+            && attackMs == other.attackMs
+            && releaseMs == other.releaseMs
+            && ratio == other.ratio
+            && bypassed == other.bypassed
+            && muted == other.muted
+            && soloed == other.soloed;
+    }
+
+    bool operator!=(const BandParameters& other) const noexcept { return ! operator==(other); }
+};
+
+struct ParameterSnapshot
+{
+    std::array<BandParameters, 3> bands;
+
+    float lowMidCrossoverHz = 400.0f;
+    float midHighCrossoverHz = 2000.0f;
+
+    float inputGainDb = 0.0f;
+    float gainDb = 0.0f;            // the output gain
+    float mixPercent = 50.0f;
+    float allpassHz = 50.0f;
+    float lookaheadMs = 0.0f;
+    int oversamplingOrder = 0;      // 0 = 1x ... 3 = 8x
+    int oversamplingFilter = 0;     // 0 = IIR, 1 = linear phase
+    int linkMode = 0;               // DetectorLinkMode
+    int precision = 0;              // MathPrecision
+    int detectorMode = 0;           // DetectorMode
+    float detectorWindowMs = 10.0f; // the RMS window
+    float detectorThresholdDb = -50.0f;
+    float detectorRatio = -30.0f;
+    bool paused = false;
+
+    uint32_t programChanges = 0;    // counts setCurrentProgram() calls, a change means crossfade
+
+    bool operator==(const ParameterSnapshot& other) const noexcept
+    {
+        return bands == other.bands
+            && lowMidCrossoverHz == other.lowMidCrossoverHz
+            && midHighCrossoverHz == other.midHighCrossoverHz
+            && inputGainDb == other.inputGainDb
+            && gainDb == other.gainDb
+            && mixPercent == other.mixPercent
+            && allpassHz == other.allpassHz
+            && lookaheadMs == other.lookaheadMs
+            && oversamplingOrder == other.oversamplingOrder
+            && oversamplingFilter == other.oversamplingFilter
+            && linkMode == other.linkMode
+            && precision == other.precision
+            && detectorMode == other.detectorMode
+            && detectorWindowMs == other.detectorWindowMs
+            && detectorThresholdDb == other.detectorThresholdDb
+            && detectorRatio == other.detectorRatio
+            && paused == other.paused
+            && programChanges == other.programChanges;
+    }
+
+    bool operator!=(const ParameterSnapshot& other) const noexcept { return ! operator==(other); }
+};
+
+/*
+ The continuous parameters ramp to a new value instead of stepping to it. The
+ ramps run at control rate: the processor advances them once per control
+ block and hands the stages where they have got to, so nothing here runs per
+ sample. Choices and switches still change at once, and attack and release
+ are times, which don't click when they jump. The lookahead isn't ramped
+ either: the delay line crossfades to a new length itself, see LookaheadDelay.
+ */
+struct SmoothedParameters
+{
+    static constexpr double rampSeconds = 0.02;
+
+    std::array<juce::SmoothedValue<float>, 3> thresholdDb;
+    juce::SmoothedValue<float, juce::ValueSmoothingTypes::Multiplicative> lowMidCrossoverHz, midHighCrossoverHz;
+    juce::SmoothedValue<float> allpassHz, inputGainDb, gainDb, mixPercent, detectorThresholdDb, detectorRatio;
+
+    // at the host rate, the ramps are counted in host samples
+    void reset(double sampleRate)
+    {
+        for (auto& value : thresholdDb)
+            value.reset(sampleRate, rampSeconds);
+
+        lowMidCrossoverHz.reset(sampleRate, rampSeconds);
+        midHighCrossoverHz.reset(sampleRate, rampSeconds);
+        allpassHz.reset(sampleRate, rampSeconds);
+        inputGainDb.reset(sampleRate, rampSeconds);
+        gainDb.reset(sampleRate, rampSeconds);
+        mixPercent.reset(sampleRate, rampSeconds);
+        detectorThresholdDb.reset(sampleRate, rampSeconds);
+        detectorRatio.reset(sampleRate, rampSeconds);
+    }
+
+    // a target that didn't move leaves its ramp alone; jump skips the ramps
+    void setTargets(const ParameterSnapshot& target, bool jump)
+    {
+        auto set = [jump](auto& value, float newTarget)
+        {
+            if (jump)
+                value.setCurrentAndTargetValue(newTarget);
+            else
+                value.setTargetValue(newTarget);
+        };
+
+        for (size_t i = 0; i < thresholdDb.size(); ++i)
+            set(thresholdDb[i], target.bands[i].thresholdDb);
+
+        set(lowMidCrossoverHz, target.lowMidCrossoverHz);
+        set(midHighCrossoverHz, target.midHighCrossoverHz);
+        set(allpassHz, target.allpassHz);
+        set(inputGainDb, target.inputGainDb);
+        set(gainDb, target.gainDb);
+        set(detectorThresholdDb, target.detectorThresholdDb);
+        set(detectorRatio, target.detectorRatio);
+
+        // pausing takes the hat removal out, with the same ramp as turning the mix down
+        set(mixPercent, target.paused ? 0.0f : target.mixPercent);
+    }
+
+    bool isSmoothing() const noexcept
+    {
+        return thresholdDb[0].isSmoothing() || thresholdDb[1].isSmoothing() || thresholdDb[2].isSmoothing()
+            || lowMidCrossoverHz.isSmoothing() || midHighCrossoverHz.isSmoothing()
+            || allpassHz.isSmoothing() || inputGainDb.isSmoothing() || gainDb.isSmoothing() || mixPercent.isSmoothing()
+            || detectorThresholdDb.isSmoothing() || detectorRatio.isSmoothing();
+    }
+
+    // moves every ramp on by numSamples, leaving the values reached in `settings`
+    void advance(int numSamples, ParameterSnapshot& settings)
+    {
+        for (size_t i = 0; i < thresholdDb.size(); ++i)
+            settings.bands[i].thresholdDb = thresholdDb[i].skip(numSamples);
+
+        settings.lowMidCrossoverHz = lowMidCrossoverHz.skip(numSamples);
+        settings.midHighCrossoverHz = midHighCrossoverHz.skip(numSamples);
+        settings.allpassHz = allpassHz.skip(numSamples);
+        settings.inputGainDb = inputGainDb.skip(numSamples);
+        settings.gainDb = gainDb.skip(numSamples);
+        settings.mixPercent = mixPercent.skip(numSamples);
+        settings.detectorThresholdDb = detectorThresholdDb.skip(numSamples);
+        settings.detectorRatio = detectorRatio.skip(numSamples);
+    }
+
+    // where the ramps are now, without moving them
+    void getCurrent(ParameterSnapshot& settings) const
+    {
+        for (size_t i = 0; i < thresholdDb.size(); ++i)
+            settings.bands[i].thresholdDb = thresholdDb[i].getCurrentValue();
+
+        settings.lowMidCrossoverHz = lowMidCrossoverHz.getCurrentValue();
+        settings.midHighCrossoverHz = midHighCrossoverHz.getCurrentValue();
+        settings.allpassHz = allpassHz.getCurrentValue();
+        settings.inputGainDb = inputGainDb.getCurrentValue();
+        settings.gainDb = gainDb.getCurrentValue();
+        settings.mixPercent = mixPercent.getCurrentValue();
+        settings.detectorThresholdDb = detectorThresholdDb.getCurrentValue();
+        settings.detectorRatio = detectorRatio.getCurrentValue();
+    }
+};
+
+/*
+ First order allpass coefficient for the hat-removal stage, at the real sample
+ rate. The cutoff is kept below Nyquist, where tan() would blow up.
+ */
+inline double calculateAllpassCoefficient(float cutoffHz, double sampleRate)
+{
+    const auto cutoff = juce::jlimit(0.0, sampleRate * 0.49, (double) cutoffHz);
+    const auto tan = std::tan(juce::MathConstants<double>::pi * cutoff / sampleRate);
+    return (tan - 1.0) / (tan + 1.0);
+}
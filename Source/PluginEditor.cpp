@@ -11,15 +11,65 @@
 
 //==============================================================================
 HatsOffAudioProcessorEditor::HatsOffAudioProcessorEditor (HatsOffAudioProcessor& p)
-    : AudioProcessorEditor (&p), audioProcessor (p)
+    : AudioProcessorEditor (&p), audioProcessor (p),
+      inputMeter ("In", meterFloorDb, 0.0f, Meter::Direction::up, juce::Colours::limegreen),
+      outputMeter ("Out", meterFloorDb, 0.0f, Meter::Direction::up, juce::Colours::limegreen),
+      bandMeters { Meter ("Low", 0.0f, maxGainReductionDb, Meter::Direction::down, juce::Colours::orange),
+                   Meter ("Mid", 0.0f, maxGainReductionDb, Meter::Direction::down, juce::Colours::orange),
+                   Meter ("High", 0.0f, maxGainReductionDb, Meter::Direction::down, juce::Colours::orange) },
+      hatMeter ("Hats", 0.0f, maxGainReductionDb, Meter::Direction::down, juce::Colours::gold),
+      parameterPanel (p.apvts)
 {
+    juce::Component* meters[] { &inputMeter, &outputMeter, &bandMeters[0], &bandMeters[1], &bandMeters[2], &hatMeter };
+
+    for (size_t i = 0; i < meterLabels.size(); ++i)
+    {
+        addAndMakeVisible(*meters[i]);
+        meterLabels[i].setText(meters[i]->getName(), juce::dontSendNotification);
+        meterLabels[i].setJustificationType(juce::Justification::centred);
+        addAndMakeVisible(meterLabels[i]);
+    }
+
+    addAndMakeVisible(history);
+
+    idleLabel.setText("idle", juce::dontSendNotification);
+    idleLabel.setJustificationType(juce::Justification::centredRight);
+    addChildComponent(idleLabel);
+
+    updateProgramList();
+    programBox.setTextWhenNothingSelected("Programs");
+    programBox.onChange = [this]
+    {
+        if (const auto index = programBox.getSelectedItemIndex(); index >= 0)
+            audioProcessor.setCurrentProgram(index);
+    };
+    addAndMakeVisible(programBox);
+
+    savePresetButton.onClick = [this] { savePreset(); };
+    addAndMakeVisible(savePresetButton);
+
+    if (StageProfiler::isEnabled())
+    {
+        profileView = std::make_unique<StageProfileView>(p.getStageProfiler());
+        addAndMakeVisible(*profileView);
+    }
+
+    parameterViewport.setViewedComponent(&parameterPanel, false);
+    parameterViewport.setScrollBarsShown(true, false);
+    addAndMakeVisible(parameterViewport);
+
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
-    setSize (400, 300);
+    setSize (860, 560 + (profileView != nullptr ? StageProfileView::preferredHeight + 8 : 0));
+
+    audioProcessor.setMeteringActive(true);
+    startTimerHz(30);
 }
 
 HatsOffAudioProcessorEditor::~HatsOffAudioProcessorEditor()
 {
+    stopTimer();
+    audioProcessor.setMeteringActive(false);
 }
 
 //==============================================================================
@@ -27,14 +77,128 @@ void HatsOffAudioProcessorEditor::paint (juce::Graphics& g)
 {
     // (Our component is opaque, so we must completely fill the background with a solid colour)
     g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
-
-    g.setColour (juce::Colours::white);
-    g.setFont (15.0f);
-    g.drawFittedText ("Hello World!", getLocalBounds(), juce::Justification::centred, 1);
 }
 
 void HatsOffAudioProcessorEditor::resized()
 {
-    // This is generally where you'll want to lay out the positions of any
-    // subcomponents in your editor..
+    auto bounds = getLocalBounds().reduced(8);
+    auto top = bounds.removeFromTop(200);
+    bounds.removeFromTop(8);
+
+    auto labels = top.removeFromBottom(20);
+    juce::Component* meters[] { &inputMeter, &outputMeter, &bandMeters[0], &bandMeters[1], &bandMeters[2], &hatMeter };
+
+    for (size_t i = 0; i < meterLabels.size(); ++i)
+    {
+        // a gap between the level and the gain reduction meters
+        if (i == 2)
+        {
+            top.removeFromLeft(12);
+            labels.removeFromLeft(12);
+        }
+
+        meters[i]->setBounds(top.removeFromLeft(36).withSizeKeepingCentre(20, top.getHeight()));
+        meterLabels[i].setBounds(labels.removeFromLeft(36));
+    }
+
+    idleLabel.setBounds(labels.removeFromRight(60));
+    history.setBounds(top);
+
+    auto programRow = bounds.removeFromTop(24);
+    bounds.removeFromTop(8);
+    programBox.setBounds(programRow.removeFromLeft(260));
+    programRow.removeFromLeft(8);
+    savePresetButton.setBounds(programRow.removeFromLeft(80));
+
+    if (profileView != nullptr)
+    {
+        profileView->setBounds(bounds.removeFromTop(StageProfileView::preferredHeight));
+        bounds.removeFromTop(8);
+    }
+
+    parameterViewport.setBounds(bounds);
+    const auto panelWidth = bounds.getWidth() - parameterViewport.getScrollBarThickness();
+    parameterPanel.setSize(panelWidth, parameterPanel.getHeightForWidth(panelWidth));
+}
+
+void HatsOffAudioProcessorEditor::timerCallback()
+{
+    MeterFrame loudest;
+    auto idle = idleLabel.isVisible();
+
+    // everything since the last tick: the meters show the loudest of it, the
+    // history gets one column per frame
+    const auto numFrames = audioProcessor.getMeterFifo().popAll([&](const MeterFrame& frame)
+    {
+        loudest.inputPeak = juce::jmax(loudest.inputPeak, frame.inputPeak);
+        loudest.inputRms = juce::jmax(loudest.inputRms, frame.inputRms);
+        loudest.outputPeak = juce::jmax(loudest.outputPeak, frame.outputPeak);
+        loudest.outputRms = juce::jmax(loudest.outputRms, frame.outputRms);
+
+        for (size_t band = 0; band < loudest.bandGainReductionDb.size(); ++band)
+            loudest.bandGainReductionDb[band] = juce::jmax(loudest.bandGainReductionDb[band], frame.bandGainReductionDb[band]);
+
+        loudest.hatGainReductionDb = juce::jmax(loudest.hatGainReductionDb, frame.hatGainReductionDb);
+        idle = frame.idle;
+
+        history.push(frame.hatGainReductionDb);
+    });
+
+    // with no frames (transport stopped) the meters just fall
+    auto toDb = [](float gain) { return juce::Decibels::gainToDecibels(gain, meterFloorDb); };
+
+    inputMeter.update(toDb(loudest.inputRms), toDb(loudest.inputPeak));
+    outputMeter.update(toDb(loudest.outputRms), toDb(loudest.outputPeak));
+
+    for (size_t band = 0; band < bandMeters.size(); ++band)
+        bandMeters[band].update(loudest.bandGainReductionDb[band], loudest.bandGainReductionDb[band]);
+
+    hatMeter.update(loudest.hatGainReductionDb, loudest.hatGainReductionDb);
+
+    if (numFrames > 0)
+        history.flush();
+
+    if (idle != idleLabel.isVisible())
+        idleLabel.setVisible(idle);
+
+    if (profileView != nullptr && --ticksUntilProfileUpdate <= 0)
+    {
+        profileView->update();
+        ticksUntilProfileUpdate = 10;
+    }
+
+    // the host may switch programs, or another instance may have saved one
+    if (programBox.getNumItems() != audioProcessor.getNumPrograms())
+        updateProgramList();
+    else if (programBox.getSelectedItemIndex() != audioProcessor.getCurrentProgram())
+        programBox.setSelectedItemIndex(audioProcessor.getCurrentProgram(), juce::dontSendNotification);
+}
+
+void HatsOffAudioProcessorEditor::updateProgramList()
+{
+    programBox.clear(juce::dontSendNotification);
+
+    for (auto i = 0; i < audioProcessor.getNumPrograms(); ++i)
+        programBox.addItem(audioProcessor.getProgramName(i), i + 1);
+
+    programBox.setSelectedItemIndex(audioProcessor.getCurrentProgram(), juce::dontSendNotification);
+}
+
+void HatsOffAudioProcessorEditor::savePreset()
+{
+    auto* window = new juce::AlertWindow("Save Preset", "Name of the new preset:", juce::MessageBoxIconType::NoIcon);
+    window->addTextEditor("name", {});
+    window->addButton("Save", 1, juce::KeyPress(juce::KeyPress::returnKey));
+    window->addButton("Cancel", 0, juce::KeyPress(juce::KeyPress::escapeKey));
+
+    juce::Component::SafePointer<HatsOffAudioProcessorEditor> editor(this);
+
+    window->enterModalState(true, juce::ModalCallbackFunction::create([editor, window](int result)
+    {
+        if (editor == nullptr || result == 0)
+            return;
+
+        if (editor->audioProcessor.saveUserPreset(window->getTextEditorContents("name")))
+            editor->updateProgramList();
+    }), true);
 }
@@ -10,11 +10,19 @@
 
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
+#include "EditorComponents.h"
 
 //==============================================================================
 /**
+ Meters and the gain-reduction history on top, then the program selector,
+ every parameter below.
+
+ The meters are fed by the processor's MeterFifo from a 30 Hz timer. Nothing
+ here ever blocks the audio thread, and a tick with nothing new in the FIFO
+ repaints nothing, so many open editors stay cheap on the message thread.
 */
-class HatsOffAudioProcessorEditor  : public juce::AudioProcessorEditor
+class HatsOffAudioProcessorEditor  : public juce::AudioProcessorEditor,
+                                     private juce::Timer
 {
 public:
     HatsOffAudioProcessorEditor (HatsOffAudioProcessor&);
@@ -29,5 +37,29 @@ private:
     // access the processor object that created it.
     HatsOffAudioProcessor& audioProcessor;
 
+    void timerCallback() override;
+    void updateProgramList();
+    void savePreset();
+
+    static constexpr float meterFloorDb = -60.0f;
+    static constexpr float maxGainReductionDb = 24.0f;
+
+    Meter inputMeter, outputMeter;
+    std::array<Meter, 3> bandMeters;
+    Meter hatMeter;
+    std::array<juce::Label, 6> meterLabels;
+    GainReductionHistory history { maxGainReductionDb };
+    juce::Label idleLabel;
+
+    juce::ComboBox programBox;
+    juce::TextButton savePresetButton { "Save..." };
+
+    // only in profiling builds
+    std::unique_ptr<StageProfileView> profileView;
+    int ticksUntilProfileUpdate = 0;
+
+    ParameterPanel parameterPanel;
+    juce::Viewport parameterViewport;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HatsOffAudioProcessorEditor)
 };
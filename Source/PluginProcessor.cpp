@@ -22,21 +22,57 @@ HatsOffAudioProcessor::HatsOffAudioProcessor()
                        )
 #endif
 {
-    compressor.threshold = dynamic_cast<juce::AudioParameterFloat*>(apvts.getParameter("Threshold"));
-    jassert(compressor.threshold != nullptr);
-
-    compressor.attack = dynamic_cast<juce::AudioParameterFloat*>(apvts.getParameter("Attack"));
-    jassert(compressor.attack != nullptr);
-
-    compressor.release = dynamic_cast<juce::AudioParameterFloat*>(apvts.getParameter("Release"));
-    jassert(compressor.release != nullptr);
+    using namespace Params;
+    const auto& params = GetParams();
     
-    compressor.ratio = dynamic_cast<juce::AudioParameterChoice*>(apvts.getParameter("Ratio"));
-    jassert(compressor.ratio != nullptr);
-
-    compressor.bypassed = dynamic_cast<juce::AudioParameterBool*>(apvts.getParameter("Bypassed"));
-    jassert(compressor.bypassed != nullptr);
+    auto floatHelper = [&apvts = this->apvts, &params](auto& param, const auto& paramName)
+    {
+        param = dynamic_cast<juce::AudioParameterFloat*>(apvts.getParameter(params.at(paramName)));
+        jassert(param != nullptr);
+    };
+    
+    auto choiceHelper = [&apvts = this->apvts, &params](auto& param, const auto& paramName)
+    {
+        param = dynamic_cast<juce::AudioParameterChoice*>(apvts.getParameter(params.at(paramName)));
+        jassert(param != nullptr);
+    };
+    
+    auto boolHelper = [&apvts = this->apvts, &params](auto& param, const auto& paramName)
+    {
+        param = dynamic_cast<juce::AudioParameterBool*>(apvts.getParameter(params.at(paramName)));
+        jassert(param != nullptr);
+    };
+    
+    floatHelper(lowBand.threshold, Names::Threshold_Low_Band);
+    floatHelper(lowBand.attack, Names::Attack_Low_Band);
+    floatHelper(lowBand.release, Names::Release_Low_Band);
+    choiceHelper(lowBand.ratio, Names::Ratio_Low_Band);
+    boolHelper(lowBand.bypassed, Names::Bypassed_Low_Band);
+    boolHelper(lowBand.mute, Names::Mute_Low_Band);
+    boolHelper(lowBand.solo, Names::Solo_Low_Band);
+    
+    floatHelper(midBand.threshold, Names::Threshold_Mid_Band);
+    floatHelper(midBand.attack, Names::Attack_Mid_Band);
+    floatHelper(midBand.release, Names::Release_Mid_Band);
+    choiceHelper(midBand.ratio, Names::Ratio_Mid_Band);
+    boolHelper(midBand.bypassed, Names::Bypassed_Mid_Band);
+    boolHelper(midBand.mute, Names::Mute_Mid_Band);
+    boolHelper(midBand.solo, Names::Solo_Mid_Band);
+    
+    floatHelper(highBand.threshold, Names::Threshold_High_Band);
+    floatHelper(highBand.attack, Names::Attack_High_Band);
+    floatHelper(highBand.release, Names::Release_High_Band);
+    choiceHelper(highBand.ratio, Names::Ratio_High_Band);
+    boolHelper(highBand.bypassed, Names::Bypassed_High_Band);
+    boolHelper(highBand.mute, Names::Mute_High_Band);
+    boolHelper(highBand.solo, Names::Solo_High_Band);
+    
+    floatHelper(lowMidCrossover, Names::Low_Mid_Crossover_Freq);
+    floatHelper(midHighCrossover, Names::Mid_High_Crossover_Freq);
 
+    inputGain = dynamic_cast<juce::AudioParameterFloat*>(apvts.getParameter("Input Gain"));
+    jassert(inputGain != nullptr);
+    
     gain = dynamic_cast<juce::AudioParameterFloat*>(apvts.getParameter("Gain"));
     jassert(gain != nullptr);
     
@@ -48,10 +84,69 @@ HatsOffAudioProcessor::HatsOffAudioProcessor()
     
     freq = dynamic_cast<juce::AudioParameterFloat*>(apvts.getParameter("Freq"));
     jassert(freq != nullptr);
+    
+    lookahead = dynamic_cast<juce::AudioParameterFloat*>(apvts.getParameter("Lookahead"));
+    jassert(lookahead != nullptr);
+    
+    oversampling = dynamic_cast<juce::AudioParameterChoice*>(apvts.getParameter("Oversampling"));
+    jassert(oversampling != nullptr);
+    
+    oversamplingFilter = dynamic_cast<juce::AudioParameterChoice*>(apvts.getParameter("Oversampling Filter"));
+    jassert(oversamplingFilter != nullptr);
+    
+    linkMode = dynamic_cast<juce::AudioParameterChoice*>(apvts.getParameter("Link Mode"));
+    jassert(linkMode != nullptr);
+    
+    precision = dynamic_cast<juce::AudioParameterChoice*>(apvts.getParameter("Precision"));
+    jassert(precision != nullptr);
+    
+    detector = dynamic_cast<juce::AudioParameterChoice*>(apvts.getParameter("Detector"));
+    jassert(detector != nullptr);
+    
+    detectorWindow = dynamic_cast<juce::AudioParameterFloat*>(apvts.getParameter("Detector Window"));
+    jassert(detectorWindow != nullptr);
+    
+    detectorThreshold = dynamic_cast<juce::AudioParameterFloat*>(apvts.getParameter("Detector Threshold"));
+    jassert(detectorThreshold != nullptr);
+    
+    detectorRatio = dynamic_cast<juce::AudioParameterFloat*>(apvts.getParameter("Detector Ratio"));
+    jassert(detectorRatio != nullptr);
+    
+    // the latency follows these, and has to be reported off the audio thread
+    for (auto* id : { "Lookahead", "Oversampling", "Oversampling Filter", "Detector" })
+        apvts.addParameterListener(id, this);
+    
+    // the binary state stores the parameters in this order, identified by these hashes
+    for (auto* processorParameter : getParameters())
+    {
+        if (auto* parameter = dynamic_cast<juce::RangedAudioParameter*>(processorParameter))
+        {
+            stateParameters.push_back(parameter);
+            stateParameterHashes.push_back(StateFormat::hashParameterID(parameter->getParameterID()));
+        }
+    }
+    
+    jassert((int) stateParameters.size() <= StateFormat::maxParameters);
+    
+   #if JUCE_DEBUG
+    // two IDs with the same hash would load one parameter's value into the other
+    {
+        auto sortedHashes = stateParameterHashes;
+        std::sort(sortedHashes.begin(), sortedHashes.end());
+        jassert(std::adjacent_find(sortedHashes.begin(), sortedHashes.end()) == sortedHashes.end());
+    }
+   #endif
+    
+    // picks up latency changes made off the message thread, see updateLatency()
+    startTimerHz(10);
 }
 
 HatsOffAudioProcessor::~HatsOffAudioProcessor()
 {
+    stopTimer();
+    
+    for (auto* id : { "Lookahead", "Oversampling", "Oversampling Filter", "Detector" })
+        apvts.removeParameterListener(id, this);
 }
 
 //==============================================================================
@@ -89,45 +184,141 @@ bool HatsOffAudioProcessor::isMidiEffect() const
 
 double HatsOffAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    // how long the output keeps going after the input stops, which is also how
+    // long the processor takes to go idle
+    return (getLatencySamples() + idleDetector.getDecaySamples()) / hostSampleRate;
 }
 
 int HatsOffAudioProcessor::getNumPrograms()
 {
-    return 1;   // NB: some hosts don't cope very well if you tell them there are 0 programs,
-                // so this should be at least 1, even if you're not really implementing programs.
+    return juce::jmax(1, presetBank->getNumPresets());   // NB: some hosts don't cope very well if you tell them there are 0 programs,
+                                                         // so this should be at least 1, even if you're not really implementing programs.
 }
 
 int HatsOffAudioProcessor::getCurrentProgram()
 {
-    return 0;
+    return currentProgram.load(std::memory_order_relaxed);
 }
 
 void HatsOffAudioProcessor::setCurrentProgram (int index)
 {
+    if (! juce::isPositiveAndBelow(index, presetBank->getNumPresets()))
+        return;
+    
+    // hosts may call this from the audio thread: the preset is already in the
+    // state format, so loading it neither parses nor allocates, and a latency
+    // it changes is handed to the host later, from the message thread (see
+    // updateLatency). The host still hears about every parameter that moves,
+    // on this thread, as with any automation
+    const auto& preset = presetBank->getPreset(index);
+    currentProgram.store(index, std::memory_order_relaxed);
+    loadState(preset.entries, preset.numEntries, true);
 }
 
 const juce::String HatsOffAudioProcessor::getProgramName (int index)
 {
-    return {};
+    if (! juce::isPositiveAndBelow(index, presetBank->getNumPresets()))
+        return {};
+    
+    return presetBank->getPreset(index).name;
 }
 
 void HatsOffAudioProcessor::changeProgramName (int index, const juce::String& newName)
 {
 }
 
+bool HatsOffAudioProcessor::saveUserPreset(const juce::String& name)
+{
+    StateFormat::Entries entries;
+    writeState(entries);
+    
+    if (! presetBank->saveUserPreset(name, entries, (int) stateParameters.size()))
+        return false;
+    
+    // the new preset holds the current values, so there is nothing to load
+    currentProgram.store(presetBank->getNumPresets() - 1, std::memory_order_relaxed);
+    updateHostDisplay(juce::AudioProcessorListener::ChangeDetails().withProgramChanged(true));
+    return true;
+}
+
 //==============================================================================
 void HatsOffAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
     // Use this method as the place to do any pre-playback
     // initialisation that you need..
     
+    const auto numChannels = juce::jmax(getTotalNumInputChannels(), getTotalNumOutputChannels());
+    
+    hostSampleRate = sampleRate;
+    maxBlockSize = samplesPerBlock;
+    idleDetector.prepare(sampleRate);
+    meterCollector.prepare(sampleRate);
+    
+    auto prepareChains = [&](auto& chains)
+    {
+        for (auto& chain : chains.chains)
+            prepareChain(chain, numChannels, samplesPerBlock);
+    
+        chains.prepare(numChannels, samplesPerBlock);
+    };
+    
+    // the host picks the precision before calling this, only those chains are ever run
+    if (isUsingDoublePrecision())
+        prepareChains(doubleChains);
+    else
+        prepareChains(floatChains);
+    
+    controlPhase = 0;
+    updateLatency();
+}
+
+template <typename SampleType>
+void HatsOffAudioProcessor::prepareChain(ProcessingChain<SampleType>& chain, int numChannels, int samplesPerBlock)
+{
+    using Oversampler = typename ProcessingChain<SampleType>::Oversampler;
+    const auto maxFactor = 1 << maxOversamplingOrder;
+    
+    for (size_t filterType = 0; filterType < chain.oversamplers.size(); ++filterType)
+    {
+        for (auto order = 1; order <= maxOversamplingOrder; ++order)
+        {
+            auto& os = chain.oversamplers[filterType][(size_t) order - 1];
+            os = std::make_unique<Oversampler>((size_t) numChannels,
+                                               (size_t) order,
+                                               filterType == 0 ? Oversampler::filterHalfBandPolyphaseIIR
+                                                               : Oversampler::filterHalfBandFIREquiripple,
+                                               true,
+                                               true);
+            os->initProcessing((size_t) samplesPerBlock);
+        }
+    }
+    
+    chain.oversampler = nullptr;
+    
+    // the sample rate may have changed, so recompute everything on the next block
+    chain.needsApplying = true;
+    chain.sampleRate = hostSampleRate;
+    chain.smoothing.reset(hostSampleRate);
+    
+    // the stages are sized for the highest oversampled rate, applyOversampling()
+    // then sets the rate they actually run at
     juce::dsp::ProcessSpec spec;
-    spec.maximumBlockSize = samplesPerBlock;
-    spec.numChannels = getTotalNumOutputChannels();
-    spec.sampleRate = sampleRate;
+    spec.maximumBlockSize = samplesPerBlock * maxFactor;
+    spec.numChannels = numChannels;
+    spec.sampleRate = hostSampleRate * maxFactor;
+    
+    const auto maxLookaheadSamples = maxFactor * getLookaheadSamples(maxLookaheadMs);
+    
+    for (auto& compressor : chain.compressors)
+        compressor.prepare(spec, maxLookaheadSamples);
+    
+    chain.bandDelay.prepare(spec.sampleRate, numChannels, maxLookaheadSamples);
+    chain.crossover.prepare(spec.sampleRate, numChannels);
+    chain.gainComputer.prepare(spec.sampleRate, samplesPerBlock, numChannels, maxLookaheadSamples);
+    chain.gainComputer.setLinkedChannels(getLinkedChannels());
     
-    compressor.prepare(spec);
+    // everything processBlock touches is sized here, the audio thread must not allocate
+    chain.allpassStage.prepare(numChannels, samplesPerBlock);
 }
 
 void HatsOffAudioProcessor::releaseResources()
@@ -143,12 +334,11 @@ bool HatsOffAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts)
     juce::ignoreUnused (layouts);
     return true;
   #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    // Some plugin hosts, such as certain GarageBand versions, will only
-    // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    // Anything from mono up to 7.1.4 (12 channels). One instance handles the
+    // whole bed, so a linked detector sees every speaker at once.
+    const auto& output = layouts.getMainOutputChannelSet();
+    
+    if (output.isDisabled() || output.size() > maxChannels)
         return false;
 
     // This checks if the input layout matches the output layout
@@ -162,9 +352,12 @@ bool HatsOffAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts)
 }
 #endif
 
-void HatsOffAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+template <typename SampleType>
+void HatsOffAudioProcessor::process(CrossfadingChains<SampleType>& chains, juce::AudioBuffer<SampleType>& buffer)
 {
     juce::ScopedNoDenormals noDenormals;
+    RealtimeGuard::ScopedRealtimeSection realtimeSection;
+    StageProfiler::ScopedBlock profiledBlock(stageProfiler, buffer.getNumSamples(), hostSampleRate);
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
     
@@ -177,134 +370,589 @@ void HatsOffAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
     
-    auto dryWetMix = juce::jmap(mix->get(), 0.0f, 100.0f, 0.0f, 1.0f);
+    // both chains keep their settings through a crossfade, whatever changed in
+    // the meantime is picked up when it's over
+    if (! chains.isCrossfading())
+    {
+        readParameterSnapshot();
     
-    juce::dsp::AudioBlock<float> audioBlock {buffer};
+        // an idle or freshly prepared chain has nothing to fade from
+        auto& activeChain = chains.getActive();
     
-    constexpr auto PI = 3.14159265359f;
-    std::vector<float> dnBuffer;
-    dnBuffer.resize(buffer.getNumChannels(), 0.f);
-    const auto sign = -1.f;
-
-    auto cutoff = freq->get();
+        if (parameters.programChanges != activeChain.targetParameters.programChanges
+            && ! activeChain.needsApplying && ! idleDetector.isIdle())
+            startCrossfade(chains);
+    
+        setTargetParameters(chains.isCrossfading() ? chains.getStandby() : activeChain);
+    }
     
-    const auto tan = std::tan(PI * cutoff / 48000); // get sample rate dynamically
-    const auto a1 = (tan - 1.f) / (tan + 1.f);
+    // the meters are only fed while an editor is showing them
+    const auto meteringWasActive = std::exchange(metering, meteringActive.load(std::memory_order_relaxed));
     
+    if (metering && ! meteringWasActive)
+        meterCollector.reset();
     
-    compressor.updateCompressorSettings();
-    compressor.process(buffer);
+    if (metering)
+    {
+        StageProfiler::ScopedStage profiled(stageProfiler, ProfiledStage::metering);
+        meterCollector.addInput(buffer);
+    }
     
-    for (auto channel = 0; channel < audioBlock.getNumChannels(); channel++)
+    // the chain was reset when it went idle, so there is nothing to restore when
+    // the input comes back, it simply starts processing again
+    const auto inputIsSilent = idleDetector.isEnabled() && IdleDetector::isSilent(buffer);
+    
+    if (idleDetector.canSkip(inputIsSilent, buffer.getNumSamples()))
     {
-        auto* data = audioBlock.getChannelPointer(channel);
+        buffer.clear();
+        controlPhase = (controlPhase + buffer.getNumSamples()) % controlBlockSize;
+        
+        if (metering)
+            meterCollector.finishBlock(meterFifo, buffer.getNumSamples(), true);
         
-        for (auto sample = 0; sample < audioBlock.getNumSamples(); sample++)
+        return;
+    }
+    
+    juce::dsp::AudioBlock<SampleType> audioBlock {buffer};
+    
+    // the oversamplers were sized for the block size given to prepareToPlay
+    for (size_t start = 0; start < audioBlock.getNumSamples(); start += (size_t) maxBlockSize)
+    {
+        auto block = audioBlock.getSubBlock(start, juce::jmin((size_t) maxBlockSize, audioBlock.getNumSamples() - start));
+    
+        if (chains.isCrossfading())
         {
-            auto input = data[sample];
-            float output = input * -1.0; // flip polarity
-            
-            // compress the signal here
-            output = compressSample(output);
-            
-            const auto allPassFilteredSample = a1 * output + dnBuffer[channel];
-            dnBuffer[channel] = output - a1 * allPassFilteredSample;
-            
-            const auto filterOutput = 0.5f * (output + sign * allPassFilteredSample);
-            
-            data[sample] = (1.0 - dryWetMix) * input + dryWetMix * filterOutput;
+            auto incoming = juce::dsp::AudioBlock<SampleType>(chains.incomingBuffer).getSubBlock(0, block.getNumSamples());
+            incoming.copyFrom(block);
+    
+            processChain(chains.getStandby(), incoming, controlPhase);
+            processChain(chains.getActive(), block, controlPhase);
+    
+            StageProfiler::ScopedStage profiled(stageProfiler, ProfiledStage::crossfade);
+            chains.mix(block, incoming);
         }
+        else
+        {
+            processChain(chains.getActive(), block, controlPhase);
+        }
+    
+        controlPhase = (controlPhase + (int) block.getNumSamples()) % controlBlockSize;
     }
     
-    auto dbGain = gain->get();
-    auto rawGain = juce::Decibels::decibelsToGain(dbGain);
-    
-    auto paused = pause->get();
-    
-    
-    
-    
-////     This is the place where you'd normally do the guts of your plugin's
-////     audio processing...
-////     Make sure to reset the state if your inner loop is processing
-////     the samples and the outer loop is handling the channels.
-////     Alternatively, you can process the samples with the channels
-////     interleaved by keeping the same state.
-//    for (int channel = 0; channel < totalNumInputChannels; ++channel)
-//    {
-//        auto* channelData = buffer.getWritePointer (channel);
-//
-//        for(int sample = 0; sample < block.getNumSamples(); ++sample)
-//        {
-////            channelData[sample] *= rawGain * -1.0;
-////            channelData[sample] = channelData[sample] * rawGain * -1.0;
-//
-//            if (rawGain < 1)
-//            {
-//                channelData[sample] *= -1.0;
-//            }
-//
-//            if (paused)
-//            {
-//                channelData[sample] = 1;
-//            }
-//        }
-//    }
-    
-//    compressor.updateCompressorSettings();
-//    compressor.process(buffer);
-}
-
-float HatsOffAudioProcessor::compressSample (float input) {
-    float _samplerate = 48000;
-    /* Initialise separate attack/release times*/
-//    auto alphaAttack = std::exp((std::log(9) * -1.0) / (_samplerate * _attack));
-    auto alphaAttack = std::exp((std::log(9) * -1.0) / (_samplerate * 0)); // immediate attack
-//    auto alphaRelease = std::exp((std::log(9) * -1.0) / (_samplerate * _release));
-    auto alphaRelease = std::exp((std::log(9) * -1.0) / (_samplerate * 0.100f));
-
-    const auto x = input;
-
-    auto x_Uni = abs(x);
-    auto x_dB = juce::Decibels::gainToDecibels(x_Uni);
-
-    if (x_dB < -96.0)
-    {
-        x_dB = -96.0;
+    // a NaN or an infinity, in the input or from anywhere else, would stay in
+    // the recursive filters for good; the block is lost, but the next one
+    // starts again from silence instead of the plugin staying broken
+    if (! isFinite(buffer))
+    {
+        buffer.clear();
+    
+        for (auto& c : chains.chains)
+            c.reset();
     }
+    
+    auto& chain = chains.getActive();
+    
+    if (inputIsSilent && idleDetector.hasHeldFor(pendingLatency.load(std::memory_order_relaxed))
+        && IdleDetector::isSilent(buffer) && chain.isSettled() && ! chains.isCrossfading())
+    {
+        chain.reset();
+        idleDetector.enterIdle();
+    }
+    
+    for (size_t band = 0; band < chain.compressors.size(); ++band)
+    {
+        const auto minimumGain = chain.compressors[band].getAndResetMinimumGain();
+        
+        if (metering)
+            meterCollector.addBandGain(band, (float) minimumGain);
+    }
+    
+    if (metering)
+    {
+        StageProfiler::ScopedStage profiled(stageProfiler, ProfiledStage::metering);
+        meterCollector.addOutput(buffer);
+        meterCollector.finishBlock(meterFifo, buffer.getNumSamples(), idleDetector.isIdle());
+    }
+}
 
-//    if (x_dB > _thresh )
-    if (x_dB > -50.0f ) // high threshold
+template <typename SampleType>
+void HatsOffAudioProcessor::processChain(ProcessingChain<SampleType>& chain, juce::dsp::AudioBlock<SampleType>& block, int phase)
+{
+    // the control work happens on a fixed grid of controlBlockSize samples that
+    // runs through the whole stream, wherever the host's blocks start and end,
+    // so neither the output nor the cost per sample depends on the block size
+    for (size_t start = 0; start < block.getNumSamples();)
     {
-        gainSC = -50.0f  + (x_dB - -50.0f ) / -30.0f ;
+        // with nothing to change, the rest of the block runs at one setting;
+        // when the settings are static that's the whole block, in one piece
+        if (! chain.hasControlWork())
+        {
+            auto rest = block.getSubBlock(start);
+            processOversampled(chain, rest);
+            return;
+        }
+    
+        if (phase == 0)
+            applyParameters(chain);
+    
+        const auto length = juce::jmin(block.getNumSamples() - start, (size_t) (controlBlockSize - phase));
+        auto controlBlock = block.getSubBlock(start, length);
+        processOversampled(chain, controlBlock);
+    
+        start += length;
+        phase = (phase + (int) length) % controlBlockSize;
     }
+}
 
+template <typename SampleType>
+void HatsOffAudioProcessor::processOversampled(ProcessingChain<SampleType>& chain, juce::dsp::AudioBlock<SampleType>& block)
+{
+    if (chain.oversampler != nullptr)
+    {
+        juce::dsp::AudioBlock<SampleType> oversampledBlock;
+    
+        {
+            StageProfiler::ScopedStage profiled(stageProfiler, ProfiledStage::oversampling);
+            oversampledBlock = chain.oversampler->processSamplesUp(block);
+        }
+    
+        processStages(chain, oversampledBlock);
+    
+        StageProfiler::ScopedStage profiled(stageProfiler, ProfiledStage::oversampling);
+        chain.oversampler->processSamplesDown(block);
+    }
     else
     {
-        gainSC = x_dB;
+        processStages(chain, block);
     }
+}
 
-    gainChange_dB = gainSC - x_dB;
+template <typename SampleType>
+void HatsOffAudioProcessor::processStages(ProcessingChain<SampleType>& chain, juce::dsp::AudioBlock<SampleType>& audioBlock)
+{
+    using GainComputer = GainComputer<SampleType>;
+    
+    auto& crossover = chain.crossover;
+    auto& gainComputer = chain.gainComputer;
+    auto& allpassStage = chain.allpassStage;
+    auto& lowBandComp = chain.compressors[0];
+    auto& midBandComp = chain.compressors[1];
+    auto& highBandComp = chain.compressors[2];
+    
+    const auto& settings = chain.appliedParameters;
+    const auto inputGain = (SampleType) juce::Decibels::decibelsToGain(settings.inputGainDb);
+    
+    allpassStage.setMix((SampleType) juce::jmap(settings.mixPercent, 0.0f, 100.0f, 0.0f, 1.0f));
+    allpassStage.setOutputGain((SampleType) juce::Decibels::decibelsToGain(settings.gainDb));
+    
+    // the bands go through the one lookahead delay, each band's gain lands on its
+    // delayed self; `ahead` is the same mix of the bands before the delay, so the
+    // hat detector sees it the lookahead early without a delay line of its own
+    auto splitAndCompress = [&](int channel, int sample, SampleType input, SampleType& ahead)
+    {
+        std::array<SampleType, 3> split, delayed;
+        crossover.processSample(channel, input, split[0], split[1], split[2]);
+        chain.bandDelay.process(channel, split.data(), delayed.data());
+    
+        const auto lowGain = lowBandComp.getGain(channel, sample, split[0]);
+        const auto midGain = midBandComp.getGain(channel, sample, split[1]);
+        const auto highGain = highBandComp.getGain(channel, sample, split[2]);
+    
+        ahead = lowGain * split[0] + midGain * split[1] + highGain * split[2];
+        return lowGain * delayed[0] + midGain * delayed[1] + highGain * delayed[2];
+    };
+    
+    const auto chunkSize = gainComputer.getMaximumBlockSize();
+    
+    const auto numChannels = (int) audioBlock.getNumChannels();
+    const auto midSide = gainComputer.isMidSide(numChannels);
+    
+    // two passes over each chunk, the gain computer's block work in between:
+    // input gain, crossover, band compressors and the detector in the first;
+    // flip, gain, allpass, dry/wet and output gain in the second
+    for (auto start = 0; start < (int) audioBlock.getNumSamples(); start += chunkSize)
+    {
+        const auto numSamples = juce::jmin(chunkSize, (int) audioBlock.getNumSamples() - start);
+    
+        const auto chunk = audioBlock.getSubBlock((size_t) start, (size_t) numSamples);
+    
+        {
+            StageProfiler::ScopedStage profiled(stageProfiler, ProfiledStage::bands);
+    
+            for (auto& compressor : chain.compressors)
+                compressor.startBlock(numSamples);
+    
+            chain.bandDelay.startBlock();
+    
+            if (midSide)
+            {
+                // everything after the detector is linear and the same on every channel,
+                // so the rest of the chain runs on M and S, formed here on the way through
+                auto* left = chunk.getChannelPointer(0);
+                auto* right = chunk.getChannelPointer(1);
+    
+                for (auto sample = 0; sample < numSamples; ++sample)
+                {
+                    SampleType leftAhead, rightAhead;
+                    const auto l = splitAndCompress(0, sample, inputGain * left[sample], leftAhead);
+                    const auto r = splitAndCompress(1, sample, inputGain * right[sample], rightAhead);
+    
+                    left[sample] = SampleType(0.5) * (l + r);
+                    right[sample] = SampleType(0.5) * (l - r);
+                    gainComputer.detectSample(0, sample, SampleType(0.5) * (leftAhead + rightAhead));
+                    gainComputer.detectSample(1, sample, SampleType(0.5) * (leftAhead - rightAhead));
+                }
+            }
+            else
+            {
+                for (auto channel = 0; channel < numChannels; ++channel)
+                {
+                    auto* data = chunk.getChannelPointer((size_t) channel);
+    
+                    for (auto sample = 0; sample < numSamples; ++sample)
+                    {
+                        SampleType ahead;
+                        data[sample] = splitAndCompress(channel, sample, inputGain * data[sample], ahead);
+                        gainComputer.detectSample(channel, sample, ahead);
+                    }
+                }
+            }
+        }
+    
+        // every channel's gain for this chunk in one call, then the second pass
+        // with the channels side by side in SIMD lanes
+        {
+            StageProfiler::ScopedStage profiled(stageProfiler, ProfiledStage::gainComputer);
+            gainComputer.computeGains(numChannels, numSamples);
+        }
+    
+        {
+            StageProfiler::ScopedStage profiled(stageProfiler, ProfiledStage::allpass);
+            allpassStage.process(chunk, gainComputer.getGainRows());
+    
+            if (midSide)
+                GainComputer::decodeMidSide(chunk.getChannelPointer(0), chunk.getChannelPointer(1), numSamples);
+        }
+    
+        if (metering)
+        {
+            StageProfiler::ScopedStage profiled(stageProfiler, ProfiledStage::metering);
+            meterCollector.addHatGain((float) gainComputer.getMinimumGain(numChannels, numSamples));
+        }
+    }
+}
 
-    if (gainChange_dB < gainSmoothPrevious)
+template <typename SampleType>
+bool HatsOffAudioProcessor::isFinite(const juce::AudioBuffer<SampleType>& buffer)
+{
+    // NaN fails every comparison, so this catches both; no early exit keeps the loop vectorised
+    auto finite = true;
+    
+    for (auto channel = 0; channel < buffer.getNumChannels(); ++channel)
     {
-        gainSmooth = ((1 - alphaAttack) * gainChange_dB) + (alphaAttack * gainSmoothPrevious);
-        currentSignal = gainSmooth;
+        const auto* data = buffer.getReadPointer(channel);
+    
+        for (auto i = 0; i < buffer.getNumSamples(); ++i)
+            finite &= std::abs(data[i]) <= std::numeric_limits<SampleType>::max();
     }
+    
+    return finite;
+}
 
+template <typename SampleType>
+void HatsOffAudioProcessor::startCrossfade(CrossfadingChains<SampleType>& chains)
+{
+    // the incoming chain starts from silence at the new settings; the warm-up
+    // covers its own latency, which the new program may have changed
+    auto& incoming = chains.getStandby();
+    incoming.reset();
+    incoming.needsApplying = true;
+    
+    const auto latency = calculateLatency(parameters.lookaheadMs, parameters.detectorMode,
+                                          parameters.oversamplingOrder, parameters.oversamplingFilter);
+    
+    chains.start(latency + juce::roundToInt(CrossfadingChains<SampleType>::warmupSeconds * hostSampleRate),
+                 juce::roundToInt(CrossfadingChains<SampleType>::fadeSeconds * hostSampleRate));
+}
+
+void HatsOffAudioProcessor::readParameterSnapshot()
+{
+    // read every parameter once per block. A state load swaps them all at once,
+    // so a block that overlaps one keeps the previous block's values instead of
+    // seeing half of the old state and half of the new one
+    const auto generation = stateGeneration.load(std::memory_order_acquire);
+    
+    if ((generation & 1u) == 0)
+    {
+        ParameterSnapshot incoming;
+        readParameters(incoming);
+        
+        std::atomic_thread_fence(std::memory_order_acquire);
+        
+        if (stateGeneration.load(std::memory_order_relaxed) == generation)
+            parameters = incoming;
+    }
+}
+
+template <typename SampleType>
+void HatsOffAudioProcessor::setTargetParameters(ProcessingChain<SampleType>& chain)
+{
+    // picked up at the chain's next control tick...
+    chain.hasNewTarget = chain.hasNewTarget || parameters != chain.targetParameters;
+    chain.targetParameters = parameters;
+    
+    // ...unless it has never been set up, then there is nothing to run until it is
+    if (chain.needsApplying)
+        applyParameters(chain);
+}
+
+template <typename SampleType>
+void HatsOffAudioProcessor::applyParameters(ProcessingChain<SampleType>& chain)
+{
+    StageProfiler::ScopedStage profiled(stageProfiler, ProfiledStage::control);
+    const auto& target = chain.targetParameters;
+    
+    // a new rate invalidates every coefficient, so it goes first and forces the rest
+    if (chain.needsApplying
+        || target.oversamplingOrder != chain.appliedParameters.oversamplingOrder
+        || target.oversamplingFilter != chain.appliedParameters.oversamplingFilter)
+    {
+        applyOversampling(chain, target.oversamplingOrder, target.oversamplingFilter);
+        chain.needsApplying = true;
+    }
+    
+    // a chain set up from scratch starts at the new values, otherwise they ramp
+    // there, one control block per tick
+    chain.smoothing.setTargets(target, chain.needsApplying);
+    
+    auto settings = target;
+    
+    if (chain.needsApplying)
+        chain.smoothing.getCurrent(settings);
     else
+        chain.smoothing.advance(controlBlockSize, settings);
+    
+    applySettings(chain, settings);
+    chain.hasNewTarget = false;
+}
+
+template <typename SampleType>
+void HatsOffAudioProcessor::applySettings(ProcessingChain<SampleType>& chain, const ParameterSnapshot& settings)
+{
+    // only recompute what depends on a value that moved
+    for (size_t i = 0; i < chain.compressors.size(); ++i)
+        if (chain.needsApplying || settings.bands[i] != chain.appliedParameters.bands[i])
+            chain.compressors[i].updateCompressorSettings(settings.bands[i]);
+    
+    // a soloed band silences the others, unless they are soloed too
+    const auto anySoloed = std::any_of(settings.bands.begin(), settings.bands.end(), [](const auto& band) { return band.soloed; });
+    
+    for (size_t i = 0; i < chain.compressors.size(); ++i)
+        chain.compressors[i].setAudible(! settings.bands[i].muted && (! anySoloed || settings.bands[i].soloed));
+    
+    if (chain.needsApplying
+        || settings.lowMidCrossoverHz != chain.appliedParameters.lowMidCrossoverHz
+        || settings.midHighCrossoverHz != chain.appliedParameters.midHighCrossoverHz)
+        chain.crossover.setCrossoverFrequencies(settings.lowMidCrossoverHz, settings.midHighCrossoverHz);
+    
+    if (chain.needsApplying || settings.linkMode != chain.appliedParameters.linkMode)
+        chain.gainComputer.setLinkMode(static_cast<DetectorLinkMode>(settings.linkMode));
+    
+    if (chain.needsApplying || settings.precision != chain.appliedParameters.precision)
     {
-        gainSmooth = ((1 - alphaRelease) * gainChange_dB) + (alphaRelease * gainSmoothPrevious);
-        currentSignal = gainSmooth;
+        const auto mathPrecision = static_cast<MathPrecision>(settings.precision);
+        
+        for (auto& compressor : chain.compressors)
+            compressor.setPrecision(mathPrecision);
+        
+        chain.gainComputer.setPrecision(mathPrecision);
     }
+    
+    if (chain.needsApplying || settings.detectorMode != chain.appliedParameters.detectorMode)
+        chain.gainComputer.setDetectorMode(static_cast<DetectorMode>(settings.detectorMode));
+    
+    if (chain.needsApplying || settings.detectorWindowMs != chain.appliedParameters.detectorWindowMs)
+        chain.gainComputer.setRmsWindow(settings.detectorWindowMs * 0.001);
+    
+    if (chain.needsApplying || settings.detectorThresholdDb != chain.appliedParameters.detectorThresholdDb)
+        chain.gainComputer.setThreshold((SampleType) settings.detectorThresholdDb);
+    
+    if (chain.needsApplying || settings.detectorRatio != chain.appliedParameters.detectorRatio)
+        chain.gainComputer.setRatio((SampleType) settings.detectorRatio);
+    
+    if (chain.needsApplying || settings.allpassHz != chain.appliedParameters.allpassHz)
+        chain.allpassStage.setCoefficient((SampleType) calculateAllpassCoefficient(settings.allpassHz, chain.sampleRate));
+    
+    if (chain.needsApplying
+        || settings.lookaheadMs != chain.appliedParameters.lookaheadMs
+        || settings.detectorMode != chain.appliedParameters.detectorMode)
+    {
+        // rounded at the host rate, so the reported latency stays a whole number of host samples
+        const auto lookaheadSamples = (1 << settings.oversamplingOrder)
+                                    * getLookaheadSamples(settings.lookaheadMs, settings.detectorMode, settings.oversamplingOrder);
+        
+        for (auto& compressor : chain.compressors)
+            compressor.setLookahead(lookaheadSamples);
+        
+        chain.bandDelay.setLookahead(lookaheadSamples);
+        chain.gainComputer.setLookahead(lookaheadSamples);
+        
+        // a chain set up afresh has nothing to fade from, the delay starts at its length
+        if (chain.needsApplying)
+            chain.bandDelay.reset();
+    }
+    
+    chain.appliedParameters = settings;
+    chain.needsApplying = false;
+}
+
+void HatsOffAudioProcessor::readParameters(ParameterSnapshot& snapshot) const
+{
+    for (size_t i = 0; i < bands.size(); ++i)
+        snapshot.bands[i] = bands[i].readParameters();
+    
+    snapshot.lowMidCrossoverHz = lowMidCrossover->get();
+    snapshot.midHighCrossoverHz = midHighCrossover->get();
+    snapshot.inputGainDb = inputGain->get();
+    snapshot.gainDb = gain->get();
+    snapshot.mixPercent = mix->get();
+    snapshot.allpassHz = freq->get();
+    snapshot.paused = pause->get();
+    snapshot.lookaheadMs = lookahead->get();
+    snapshot.oversamplingOrder = oversampling->getIndex();
+    snapshot.oversamplingFilter = oversamplingFilter->getIndex();
+    snapshot.linkMode = linkMode->getIndex();
+    snapshot.precision = precision->getIndex();
+    snapshot.detectorMode = detector->getIndex();
+    snapshot.detectorWindowMs = detectorWindow->get();
+    snapshot.detectorThresholdDb = detectorThreshold->get();
+    snapshot.detectorRatio = detectorRatio->get();
+    snapshot.programChanges = programChanges.load(std::memory_order_relaxed);
+}
+
+template <typename SampleType>
+void HatsOffAudioProcessor::applyOversampling(ProcessingChain<SampleType>& chain, int order, int filterType)
+{
+    chain.oversampler = chain.getOversampler(order, filterType);
+    
+    if (chain.oversampler != nullptr)
+        chain.oversampler->reset();
+    
+    // none of these allocate, everything was sized for 8x in prepareToPlay
+    chain.sampleRate = hostSampleRate * (1 << juce::jlimit(0, maxOversamplingOrder, order));
+    
+    for (auto& compressor : chain.compressors)
+        compressor.setSampleRate(chain.sampleRate);
+    
+    chain.bandDelay.setSampleRate(chain.sampleRate);
+    chain.crossover.setSampleRate(chain.sampleRate);
+    chain.gainComputer.setSampleRate(chain.sampleRate);
+    chain.allpassStage.reset();
+}
+
+void HatsOffAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    jassert(! isUsingDoublePrecision());
+    process(floatChains, buffer);
+}
+
+void HatsOffAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+    jassert(isUsingDoublePrecision());
+    process(doubleChains, buffer);
+}
+
+bool HatsOffAudioProcessor::supportsDoublePrecisionProcessing() const
+{
+    return true;
+}
 
-    gainSmoothPrevious = gainSmooth;
+uint32_t HatsOffAudioProcessor::getLinkedChannels() const
+{
+    // the LFE carries no hats, and its level would only pull the whole bed down
+    const auto layout = getChannelLayoutOfBus(true, 0);
+    auto mask = 0u;
+    
+    for (auto channel = 0; channel < layout.size(); ++channel)
+    {
+        const auto type = layout.getTypeOfChannel(channel);
+        
+        if (type != juce::AudioChannelSet::LFE && type != juce::AudioChannelSet::LFE2)
+            mask |= 1u << channel;
+    }
+    
+    return mask;
+}
 
-    auto mix = (1.0 - .5) * x + (x * juce::Decibels::decibelsToGain(gainSmooth)) * .5;
-//    auto mix = (1.0 - _mix.getNextValue()) * x + (x * juce::Decibels::decibelsToGain(gainSmooth)) * _mix.getNextValue();
+int HatsOffAudioProcessor::getLookaheadSamples(float lookaheadMs) const
+{
+    return (int) std::ceil(lookaheadMs * 0.001 * hostSampleRate);
+}
 
-    return mix;
-//    return sample;
+int HatsOffAudioProcessor::getLookaheadSamples(float lookaheadMs, int detectorMode, int order) const
+{
+    const auto samples = getLookaheadSamples(lookaheadMs);
+    
+    if (static_cast<DetectorMode>(detectorMode) != DetectorMode::truePeak)
+        return samples;
+    
+    // the true-peak level lags by its interpolator, at the chain's rate; the lookahead makes up for it
+    const auto factor = 1 << order;
+    return juce::jmax(samples, (LevelDetector<float>::truePeakLatency + factor - 1) / factor);
+}
+
+int HatsOffAudioProcessor::getOversamplingLatency(int order, int filterType) const
+{
+    // only the chains prepareToPlay built have oversamplers, and both have the same ones
+    if (isUsingDoublePrecision())
+    {
+        if (auto* os = doubleChains.getActive().getOversampler(order, filterType))
+            return juce::roundToInt(os->getLatencyInSamples());
+    }
+    else if (auto* os = floatChains.getActive().getOversampler(order, filterType))
+    {
+        return juce::roundToInt(os->getLatencyInSamples());
+    }
+    
+    return 0;
+}
+
+int HatsOffAudioProcessor::calculateLatency(float lookaheadMs, int detectorMode, int order, int filterType) const
+{
+    // the bands' lookahead delay is the only one in the chain, and the
+    // oversampling filters add theirs on top
+    return getLookaheadSamples(lookaheadMs, detectorMode, order) + getOversamplingLatency(order, filterType);
+}
+
+void HatsOffAudioProcessor::updateLatency()
+{
+    pendingLatency.store(calculateLatency(lookahead->get(), detector->getIndex(), oversampling->getIndex(), oversamplingFilter->getIndex()),
+                         std::memory_order_relaxed);
+    
+    // setLatencySamples() calls into the host, so it only ever happens on the message
+    // thread; a change from anywhere else, host automation on the audio thread
+    // included, waits for the timer
+    if (juce::MessageManager::existsAndIsCurrentThread())
+        reportLatency();
+}
+
+void HatsOffAudioProcessor::reportLatency()
+{
+    const auto latency = pendingLatency.load(std::memory_order_relaxed);
+    
+    if (latency != getLatencySamples())
+        setLatencySamples(latency);
+}
+
+void HatsOffAudioProcessor::parameterChanged(const juce::String& parameterID, float newValue)
+{
+    juce::ignoreUnused(parameterID, newValue);
+    updateLatency();
+}
+
+void HatsOffAudioProcessor::timerCallback()
+{
+    reportLatency();
 }
 
 //==============================================================================
@@ -315,8 +963,7 @@ bool HatsOffAudioProcessor::hasEditor() const
 
 juce::AudioProcessorEditor* HatsOffAudioProcessor::createEditor()
 {
-//    return new HatsOffAudioProcessorEditor (*this);
-    return new juce::GenericAudioProcessorEditor(*this);
+    return new HatsOffAudioProcessorEditor (*this);
 }
 
 //==============================================================================
@@ -325,64 +972,168 @@ void HatsOffAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
     // You should use this method to store your parameters in the memory block.
     // You could do that either as raw data, or use the XML or ValueTree classes
     // as intermediaries to make it easy to save and load complex data.
-    juce::MemoryOutputStream mos(destData, true);
-    apvts.state.writeToStream(mos);
+    StateFormat::Entries entries;
+    writeState(entries);
+    StateFormat::write(destData, entries.data(), (int) stateParameters.size());
+}
+
+void HatsOffAudioProcessor::writeState(StateFormat::Entries& entries) const
+{
+    for (size_t i = 0; i < stateParameters.size(); ++i)
+    {
+        auto* parameter = stateParameters[i];
+        entries[i] = { stateParameterHashes[i], parameter->convertFrom0to1(parameter->getValue()) };
+    }
 }
 
 void HatsOffAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
     // You should use this method to restore your parameters from this memory block,
     // whose contents will have been created by the getStateInformation() call.
+    if (StateFormat::hasMagic(data, sizeInBytes))
+    {
+        StateFormat::Entries entries;
+        const auto numEntries = StateFormat::read(data, sizeInBytes, entries);
+        
+        if (numEntries >= 0)
+            loadState(entries, numEntries);
+        
+        return;
+    }
+    
+    // sessions saved before the binary format
     auto tree = juce::ValueTree::readFromData(data, sizeInBytes);
     if ( tree.isValid() )
     {
+        mapLegacyParameters(tree);
+        
+        ScopedStateSwap swap(stateGeneration);
         apvts.replaceState(tree);
     }
 }
 
+void HatsOffAudioProcessor::mapLegacyParameters(juce::ValueTree& tree)
+{
+    // the first version had one compressor over the whole signal, with the IDs
+    // the bands have since taken with a suffix; each band starts from its settings
+    static const juce::Identifier idProperty ("id");
+    
+    for (auto* legacyID : { "Threshold", "Attack", "Release", "Ratio", "Bypassed" })
+    {
+        auto legacy = tree.getChildWithProperty(idProperty, legacyID);
+        
+        if (! legacy.isValid())
+            continue;
+        
+        for (auto* band : { " Low Band", " Mid Band", " High Band" })
+        {
+            const auto bandID = juce::String(legacyID) + band;
+            
+            if (tree.getChildWithProperty(idProperty, bandID).isValid())
+                continue;
+            
+            auto copy = legacy.createCopy();
+            copy.setProperty(idProperty, bandID, nullptr);
+            tree.appendChild(copy, nullptr);
+        }
+        
+        tree.removeChild(legacy, nullptr);
+    }
+}
+
+void HatsOffAudioProcessor::loadState(const StateFormat::Entries& entries, int numEntries, bool isProgramChange)
+{
+    ScopedStateSwap swap(stateGeneration);
+    
+    // counted inside the swap, so the block that sees the new values also sees
+    // that they came with a program change, and crossfades to them
+    if (isProgramChange)
+        programChanges.fetch_add(1, std::memory_order_relaxed);
+    
+    for (size_t i = 0; i < stateParameters.size(); ++i)
+    {
+        const auto hash = stateParameterHashes[i];
+        
+        // states written by this version line up with stateParameters, so the
+        // search only runs for an older layout; a parameter the state doesn't
+        // have goes back to its default
+        auto* entry = i < (size_t) numEntries && entries[i].idHash == hash ? &entries[i] : nullptr;
+        
+        for (auto j = 0; entry == nullptr && j < numEntries; ++j)
+            if (entries[(size_t) j].idHash == hash)
+                entry = &entries[(size_t) j];
+        
+        auto* parameter = stateParameters[i];
+        const auto value = entry != nullptr ? parameter->convertTo0to1(entry->value)
+                                            : parameter->getDefaultValue();
+        
+        // only the ones that moved notify the host and the listeners
+        if (value != parameter->getValue())
+            parameter->setValueNotifyingHost(value);
+    }
+}
+
 juce::AudioProcessorValueTreeState::ParameterLayout HatsOffAudioProcessor::createParameterLayout()
 {
     APVTS::ParameterLayout layout;
     
     using namespace juce;
+    using namespace Params;
+    const auto& params = GetParams();
     
-    layout.add(std::make_unique<AudioParameterFloat>(ParameterID {"Threshold", 1},
-                                                     "Threshold",
-                                                     NormalisableRange<float>(-60, 12, 1, 1),
-                                                     0));
+    auto thresholdRange = NormalisableRange<float>(-60, 12, 1, 1);
     
-    auto attackReleaseRange = NormalisableRange<float>(0, 500, 1, 1);
+    for (auto name : { Names::Threshold_Low_Band, Names::Threshold_Mid_Band, Names::Threshold_High_Band })
+        layout.add(std::make_unique<AudioParameterFloat>(ParameterID {params.at(name), 1},
+                                                         params.at(name),
+                                                         thresholdRange,
+                                                         0));
     
-    layout.add(std::make_unique<AudioParameterFloat>(ParameterID {"Attack", 1},
-                                                     "Attack",
-                                                     attackReleaseRange,
-                                                     50));
+    auto attackReleaseRange = NormalisableRange<float>(0, 500, 1, 1);
     
-    layout.add(std::make_unique<AudioParameterFloat>(ParameterID {"Release", 1},
-                                                     "Release",
-                                                     attackReleaseRange,
-                                                     250));
+    for (auto name : { Names::Attack_Low_Band, Names::Attack_Mid_Band, Names::Attack_High_Band })
+        layout.add(std::make_unique<AudioParameterFloat>(ParameterID {params.at(name), 1},
+                                                         params.at(name),
+                                                         attackReleaseRange,
+                                                         50));
     
-    auto choices = std::vector<double>{ 1, 1.5, 2, 3, 4, 5, 6, 7, 8, 10, 15, 20, 50, 100 };
+    for (auto name : { Names::Release_Low_Band, Names::Release_Mid_Band, Names::Release_High_Band })
+        layout.add(std::make_unique<AudioParameterFloat>(ParameterID {params.at(name), 1},
+                                                         params.at(name),
+                                                         attackReleaseRange,
+                                                         250));
     
     juce::StringArray sa;
-    for (auto choice : choices)
+    for (auto choice : RatioChoices)
     {
         sa.add( juce::String(choice, 1) );
     }
     
-    layout.add(std::make_unique<AudioParameterChoice>(ParameterID {"Ratio", 1},
-                                                      "Ratio",
-                                                      sa,
-                                                      3));
+    for (auto name : { Names::Ratio_Low_Band, Names::Ratio_Mid_Band, Names::Ratio_High_Band })
+        layout.add(std::make_unique<AudioParameterChoice>(ParameterID {params.at(name), 1},
+                                                          params.at(name),
+                                                          sa,
+                                                          3));
+    
+    for (auto name : { Names::Bypassed_Low_Band, Names::Bypassed_Mid_Band, Names::Bypassed_High_Band })
+        layout.add(std::make_unique<AudioParameterBool>(ParameterID {params.at(name), 1}, params.at(name), false));
     
-    layout.add(std::make_unique<AudioParameterBool>(ParameterID {"Bypassed", 1}, "Bypassed", false));
+    layout.add(std::make_unique<AudioParameterFloat>(ParameterID {params.at(Names::Low_Mid_Crossover_Freq), 1},
+                                                     params.at(Names::Low_Mid_Crossover_Freq),
+                                                     NormalisableRange<float>(20, 999, 1, 1),
+                                                     400));
     
+    layout.add(std::make_unique<AudioParameterFloat>(ParameterID {params.at(Names::Mid_High_Crossover_Freq), 1},
+                                                     params.at(Names::Mid_High_Crossover_Freq),
+                                                     NormalisableRange<float>(1000, 20000, 1, 1),
+                                                     2000));
     
+    
+    // the output gain; everything after the hat removal
     layout.add(std::make_unique<AudioParameterFloat>(ParameterID {"Gain", 1},
                                                      "Gain",
                                                      NormalisableRange<float>(-60, 12, 1, 1),
-                                                     1));
+                                                     0));
     
     layout.add(std::make_unique<AudioParameterBool>(ParameterID {"Pause", 1}, "Pause", false));
     
@@ -396,6 +1147,65 @@ juce::AudioProcessorValueTreeState::ParameterLayout HatsOffAudioProcessor::creat
                                                      NormalisableRange<float>(0, 20000, 1, 1),
                                                      50));
     
+    layout.add(std::make_unique<AudioParameterFloat>(ParameterID {"Lookahead", 1},
+                                                     "Lookahead",
+                                                     NormalisableRange<float>(0, maxLookaheadMs, 0.1f, 1),
+                                                     0));
+    
+    layout.add(std::make_unique<AudioParameterChoice>(ParameterID {"Oversampling", 1},
+                                                      "Oversampling",
+                                                      StringArray { "1x", "2x", "4x", "8x" },
+                                                      0));
+    
+    layout.add(std::make_unique<AudioParameterChoice>(ParameterID {"Oversampling Filter", 1},
+                                                      "Oversampling Filter",
+                                                      StringArray { "IIR", "Linear Phase" },
+                                                      0));
+    
+    // same order as DetectorLinkMode
+    layout.add(std::make_unique<AudioParameterChoice>(ParameterID {"Link Mode", 1},
+                                                      "Link Mode",
+                                                      StringArray { "Unlinked", "Max", "Average", "Mid/Side" },
+                                                      0));
+    
+    // added after the others, so states saved before them still line up
+    layout.add(std::make_unique<AudioParameterFloat>(ParameterID {"Input Gain", 1},
+                                                     "Input Gain",
+                                                     NormalisableRange<float>(-24, 24, 0.1f, 1),
+                                                     0));
+    
+    for (auto name : { Names::Mute_Low_Band, Names::Mute_Mid_Band, Names::Mute_High_Band,
+                       Names::Solo_Low_Band, Names::Solo_Mid_Band, Names::Solo_High_Band })
+        layout.add(std::make_unique<AudioParameterBool>(ParameterID {params.at(name), 1}, params.at(name), false));
+    
+    // same order as MathPrecision; Fast trades a few millionths of a dB in the detectors for speed
+    layout.add(std::make_unique<AudioParameterChoice>(ParameterID {"Precision", 1},
+                                                      "Precision",
+                                                      StringArray { "Exact", "Fast" },
+                                                      0));
+    
+    // the hat detector; the threshold and ratio defaults are the values it has always used.
+    // A negative ratio pushes the level over the threshold below it, which is what takes the hats out
+    layout.add(std::make_unique<AudioParameterChoice>(ParameterID {"Detector", 1},
+                                                      "Detector",
+                                                      StringArray { "Peak", "RMS", "True Peak" },
+                                                      0));
+    
+    layout.add(std::make_unique<AudioParameterFloat>(ParameterID {"Detector Window", 1},
+                                                     "Detector Window",
+                                                     NormalisableRange<float>(1, (float) (LevelDetector<float>::maxRmsWindowSeconds * 1000.0), 0.1f, 1),
+                                                     10));
+    
+    layout.add(std::make_unique<AudioParameterFloat>(ParameterID {"Detector Threshold", 1},
+                                                     "Detector Threshold",
+                                                     NormalisableRange<float>(-96, 0, 0.1f, 1),
+                                                     -50));
+    
+    layout.add(std::make_unique<AudioParameterFloat>(ParameterID {"Detector Ratio", 1},
+                                                     "Detector Ratio",
+                                                     NormalisableRange<float>(-100, -1, 0.1f, 1),
+                                                     -30));
+    
     return layout;
 }
 
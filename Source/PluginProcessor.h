@@ -9,6 +9,18 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "GainComputer.h"
+#include "AllpassStage.h"
+#include "CompressorBand.h"
+#include "Lookahead.h"
+#include "RealtimeGuard.h"
+#include "StageProfiler.h"
+#include "Crossover.h"
+#include "ParameterSnapshot.h"
+#include "IdleDetector.h"
+#include "MeterFifo.h"
+#include "StateFormat.h"
+#include "PresetBank.h"
 
 /*
  Roadmap
@@ -32,48 +44,245 @@
  - how do I set compressor makeup gain to 0?
  */
 
-struct CompressorBand
+namespace Params
+{
+enum Names
+{
+    Low_Mid_Crossover_Freq,
+    Mid_High_Crossover_Freq,
+    
+    Threshold_Low_Band,
+    Threshold_Mid_Band,
+    Threshold_High_Band,
+    
+    Attack_Low_Band,
+    Attack_Mid_Band,
+    Attack_High_Band,
+    
+    Release_Low_Band,
+    Release_Mid_Band,
+    Release_High_Band,
+    
+    Ratio_Low_Band,
+    Ratio_Mid_Band,
+    Ratio_High_Band,
+    
+    Bypassed_Low_Band,
+    Bypassed_Mid_Band,
+    Bypassed_High_Band,
+    
+    Mute_Low_Band,
+    Mute_Mid_Band,
+    Mute_High_Band,
+    
+    Solo_Low_Band,
+    Solo_Mid_Band,
+    Solo_High_Band,
+};
+
+inline const std::map<Names, juce::String>& GetParams()
+{
+    static std::map<Names, juce::String> params =
+    {
+        {Low_Mid_Crossover_Freq, "Low-Mid Crossover Freq"},
+        {Mid_High_Crossover_Freq, "Mid-High Crossover Freq"},
+        {Threshold_Low_Band, "Threshold Low Band"},
+        {Threshold_Mid_Band, "Threshold Mid Band"},
+        {Threshold_High_Band, "Threshold High Band"},
+        {Attack_Low_Band, "Attack Low Band"},
+        {Attack_Mid_Band, "Attack Mid Band"},
+        {Attack_High_Band, "Attack High Band"},
+        {Release_Low_Band, "Release Low Band"},
+        {Release_Mid_Band, "Release Mid Band"},
+        {Release_High_Band, "Release High Band"},
+        {Ratio_Low_Band, "Ratio Low Band"},
+        {Ratio_Mid_Band, "Ratio Mid Band"},
+        {Ratio_High_Band, "Ratio High Band"},
+        {Bypassed_Low_Band, "Bypassed Low Band"},
+        {Bypassed_Mid_Band, "Bypassed Mid Band"},
+        {Bypassed_High_Band, "Bypassed High Band"},
+        {Mute_Low_Band, "Mute Low Band"},
+        {Mute_Mid_Band, "Mute Mid Band"},
+        {Mute_High_Band, "Mute High Band"},
+        {Solo_Low_Band, "Solo Low Band"},
+        {Solo_Mid_Band, "Solo Mid Band"},
+        {Solo_High_Band, "Solo High Band"},
+    };
+    
+    return params;
+}
+
+// the Ratio choices, by index, so the audio thread never parses the choice name
+inline constexpr std::array<float, 14> RatioChoices { 1.f, 1.5f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f, 8.f, 10.f, 15.f, 20.f, 50.f, 100.f };
+}
+
+// The parameters of one band. The DSP that runs them is CompressorBand.
+struct BandControls
 {
     juce::AudioParameterFloat* threshold { nullptr };
     juce::AudioParameterFloat* attack { nullptr };
     juce::AudioParameterFloat* release { nullptr };
     juce::AudioParameterChoice* ratio { nullptr };
     juce::AudioParameterBool* bypassed { nullptr };
+    juce::AudioParameterBool* mute { nullptr };
+    juce::AudioParameterBool* solo { nullptr };
     
-    void prepare(juce::dsp::ProcessSpec& spec)
+    BandParameters readParameters() const
     {
-        compressor.prepare(spec);
+        return { threshold->get(),
+                 attack->get(),
+                 release->get(),
+                 Params::RatioChoices[(size_t) ratio->getIndex()],
+                 bypassed->get(),
+                 mute->get(),
+                 solo->get() };
     }
+};
+
+/*
+ Everything processBlock runs, for one sample type. The processor holds a pair
+ for float and a pair for double, and prepares whichever the host will call.
+ */
+template <typename SampleType>
+struct ProcessingChain
+{
+    static constexpr int maxOversamplingOrder = 3; // 8x
+    using Oversampler = juce::dsp::Oversampling<SampleType>;
     
-    void updateCompressorSettings()
+    Oversampler* getOversampler(int order, int filterType) const
     {
-        compressor.setThreshold(threshold->get());
-        compressor.setAttack(attack->get());
-        compressor.setRelease(release->get());
-        compressor.setRatio(ratio->getCurrentChoiceName().getFloatValue() );
-//        compressor.setAttack(0.0);
-//        compressor.setRelease(100.0);
-//        compressor.setThreshold(-60.0);
-//        compressor.setRatio(100.0);
+        if (order <= 0 || order > maxOversamplingOrder)
+            return nullptr;
+        
+        return oversamplers[(size_t) juce::jlimit(0, 1, filterType)][(size_t) order - 1].get();
     }
     
-    void process(juce::AudioBuffer<float>& buffer)
+    // one oversampler per factor and filter type, all built in prepareToPlay so
+    // switching between them on the audio thread never allocates
+    std::array<std::array<std::unique_ptr<Oversampler>, maxOversamplingOrder>, 2> oversamplers;
+    Oversampler* oversampler { nullptr };
+    
+    std::array<CompressorBand<SampleType>, 3> compressors;
+    LookaheadDelay<SampleType, 3> bandDelay;    // the lookahead, once for all three bands
+    ThreeBandCrossover<SampleType> crossover;
+    GainComputer<SampleType> gainComputer;
+    AllpassStage<SampleType> allpassStage;
+    
+    // the settings the stages were last set to, the ones they are heading for,
+    // and the rate they run at
+    ParameterSnapshot appliedParameters, targetParameters;
+    SmoothedParameters smoothing;
+    bool needsApplying = true;
+    bool hasNewTarget = false;
+    double sampleRate = 44100.0;
+    
+    // whether the next control tick has anything to do
+    bool hasControlWork() const noexcept    { return hasNewTarget || smoothing.isSmoothing(); }
+    
+    // back to the state of a freshly prepared chain, at the current settings
+    void reset()
     {
-        auto block = juce::dsp::AudioBlock<float>(buffer);
-        auto context = juce::dsp::ProcessContextReplacing<float>(block); // should this be non-replacing?
+        if (oversampler != nullptr)
+            oversampler->reset();
+        
+        for (auto& compressor : compressors)
+            compressor.reset();
         
-        context.isBypassed = bypassed->get();
-        compressor.process(context);
+        bandDelay.reset();
+        crossover.reset();
+        gainComputer.reset();
+        allpassStage.reset();
     }
-private:
-    juce::dsp::Compressor<float> compressor;
     
+    // no envelope is holding any gain reduction
+    bool isSettled() const noexcept
+    {
+        for (auto& compressor : compressors)
+            if (! compressor.isSettled())
+                return false;
+        
+        return gainComputer.isSettled();
+    }
+};
+
+/*
+ Two chains, so that a program change crossfades instead of jumping. The new
+ program goes to the standby chain, which is reset and then runs on a copy of
+ the input next to the active one: first for a warm-up, long enough to fill its
+ delay lines and let its envelopes catch up, while only the active chain is
+ heard, then through a short linear crossfade, after which it is the active
+ chain. Both chains are prepared up front, so a switch never allocates.
+ */
+template <typename SampleType>
+struct CrossfadingChains
+{
+    static constexpr double warmupSeconds = 0.01; // on top of the incoming chain's latency
+    static constexpr double fadeSeconds = 0.02;
+    
+    ProcessingChain<SampleType>& getActive() noexcept           { return chains[active]; }
+    ProcessingChain<SampleType>& getStandby() noexcept          { return chains[1 - active]; }
+    const ProcessingChain<SampleType>& getActive() const noexcept   { return chains[active]; }
+    
+    bool isCrossfading() const noexcept     { return warmupRemaining > 0 || fadeRemaining > 0; }
+    
+    void prepare(int numChannels, int samplesPerBlock)
+    {
+        incomingBuffer.setSize(numChannels, samplesPerBlock);
+        warmupRemaining = fadeRemaining = 0;
+    }
+    
+    void start(int warmupSamples, int fadeSamples) noexcept
+    {
+        warmupRemaining = warmupSamples;
+        fadeLength = fadeRemaining = juce::jmax(1, fadeSamples);
+    }
+    
+    // `output` holds the active chain's output and `incoming` the standby's; the
+    // mix is left in `output`, and the chains swap once the fade is complete
+    void mix(juce::dsp::AudioBlock<SampleType>& output, const juce::dsp::AudioBlock<SampleType>& incoming) noexcept
+    {
+        const auto numSamples = (int) output.getNumSamples();
+        const auto fadeStart = juce::jmin(warmupRemaining, numSamples);
+        const auto fadeEnd = juce::jmin(numSamples, fadeStart + fadeRemaining);
+        const auto step = (SampleType) 1 / (SampleType) fadeLength;
+        const auto firstGain = (SampleType) (fadeLength - fadeRemaining) * step;
+    
+        for (size_t channel = 0; channel < output.getNumChannels(); ++channel)
+        {
+            auto* out = output.getChannelPointer(channel);
+            const auto* in = incoming.getChannelPointer(channel);
+            auto gain = firstGain;
+    
+            for (auto i = fadeStart; i < fadeEnd; ++i)
+            {
+                gain += step;
+                out[i] += gain * (in[i] - out[i]);
+            }
+    
+            // the fade finished inside this block
+            for (auto i = fadeEnd; i < numSamples; ++i)
+                out[i] = in[i];
+        }
+    
+        warmupRemaining -= fadeStart;
+        fadeRemaining -= fadeEnd - fadeStart;
+    
+        if (! isCrossfading())
+            active = 1 - active;
+    }
+    
+    std::array<ProcessingChain<SampleType>, 2> chains;
+    size_t active = 0;
+    juce::AudioBuffer<SampleType> incomingBuffer; // the standby chain's copy of the input
+    int warmupRemaining = 0, fadeRemaining = 0, fadeLength = 1;
 };
 
 //==============================================================================
 /**
 */
-class HatsOffAudioProcessor  : public juce::AudioProcessor
+class HatsOffAudioProcessor  : public juce::AudioProcessor,
+                               private juce::AudioProcessorValueTreeState::Listener,
+                               private juce::Timer
                             #if JucePlugin_Enable_ARA
                              , public juce::AudioProcessorARAExtension
                             #endif
@@ -92,10 +301,11 @@ public:
    #endif
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+    bool supportsDoublePrecisionProcessing() const override;
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
-    float compressSample (float sample);
     bool hasEditor() const override;
 
     //==============================================================================
@@ -121,30 +331,141 @@ public:
     static APVTS::ParameterLayout createParameterLayout();
     
     APVTS apvts { *this, nullptr, "Parameters", createParameterLayout() };
+    
+    // true while silent input lets processBlock skip the DSP, see IdleDetector
+    bool isIdle() const noexcept                        { return idleDetector.isIdle(); }
+    void setIdleDetectionEnabled(bool shouldBeEnabled)  { idleDetector.setEnabled(shouldBeEnabled); }
+    
+    // the editor's end of the meter FIFO; frames are only pushed while metering is active
+    MeterFifo& getMeterFifo() noexcept                  { return meterFifo; }
+    void setMeteringActive(bool shouldBeActive)         { meteringActive.store(shouldBeActive, std::memory_order_relaxed); }
+    
+    // per-stage timings, only collected in HATSOFF_PROFILING builds
+    StageProfiler& getStageProfiler() noexcept          { return stageProfiler; }
+    
+    // stores the current settings as a user preset, which becomes the current program
+    bool saveUserPreset(const juce::String& name);
 
 private:
-//    juce::dsp::Compressor<float> compressor;
+    juce::AudioParameterFloat* inputGain { nullptr };
     juce::AudioParameterFloat* gain { nullptr };
-//    juce::AudioParameterFloat* threshold { nullptr };
-//    juce::AudioParameterFloat* attack { nullptr };
-//    juce::AudioParameterFloat* release { nullptr };
-//    juce::AudioParameterChoice* ratio { nullptr };
-//    juce::AudioParameterBool* bypassed { nullptr };
     juce::AudioParameterBool* pause { nullptr };
     
     juce::AudioParameterFloat* mix { nullptr };
     
     juce::AudioParameterFloat* freq { nullptr };
+    
+    juce::AudioParameterFloat* lookahead { nullptr };
+    juce::AudioParameterChoice* oversampling { nullptr };
+    juce::AudioParameterChoice* oversamplingFilter { nullptr };
+    juce::AudioParameterChoice* linkMode { nullptr };
+    juce::AudioParameterChoice* precision { nullptr };
+    juce::AudioParameterChoice* detector { nullptr };
+    juce::AudioParameterFloat* detectorWindow { nullptr };
+    juce::AudioParameterFloat* detectorThreshold { nullptr };
+    juce::AudioParameterFloat* detectorRatio { nullptr };
 
-    juce::SmoothedValue<float> _mix;
-
-    float gainSC = 0.0f;
-    float gainSmooth = 0.0f;
-    float gainSmoothPrevious = 0.0f;
-    float currentSignal = 0.0f;
-    float gainChange_dB = 0.0f;
+    template <typename SampleType>
+    void prepareChain(ProcessingChain<SampleType>& chain, int numChannels, int samplesPerBlock);
+    
+    template <typename SampleType>
+    void process(CrossfadingChains<SampleType>& chains, juce::AudioBuffer<SampleType>& buffer);
+    
+    template <typename SampleType>
+    void processChain(ProcessingChain<SampleType>& chain, juce::dsp::AudioBlock<SampleType>& block, int phase);
+    
+    template <typename SampleType>
+    void processOversampled(ProcessingChain<SampleType>& chain, juce::dsp::AudioBlock<SampleType>& block);
+    
+    template <typename SampleType>
+    void processStages(ProcessingChain<SampleType>& chain, juce::dsp::AudioBlock<SampleType>& block);
+    
+    template <typename SampleType>
+    void startCrossfade(CrossfadingChains<SampleType>& chains);
+    
+    template <typename SampleType>
+    static bool isFinite(const juce::AudioBuffer<SampleType>& buffer);
+    
+    template <typename SampleType>
+    void setTargetParameters(ProcessingChain<SampleType>& chain);
+    
+    template <typename SampleType>
+    void applyParameters(ProcessingChain<SampleType>& chain);
+    
+    template <typename SampleType>
+    void applySettings(ProcessingChain<SampleType>& chain, const ParameterSnapshot& settings);
+    
+    template <typename SampleType>
+    void applyOversampling(ProcessingChain<SampleType>& chain, int order, int filterType);
+    
+    int getOversamplingLatency(int order, int filterType) const;
+    int calculateLatency(float lookaheadMs, int detectorMode, int order, int filterType) const;
+    
+    static constexpr float maxLookaheadMs = 10.0f;
+    static constexpr int maxChannels = 12; // 7.1.4
+    static constexpr int controlBlockSize = 32; // host samples between two control ticks
+    
+    uint32_t getLinkedChannels() const;
+    int getLookaheadSamples(float lookaheadMs) const; // at the host rate
+    int getLookaheadSamples(float lookaheadMs, int detectorMode, int order) const; // what the chain runs with
+    void updateLatency();
+    void reportLatency();
+    void parameterChanged(const juce::String& parameterID, float newValue) override;
+    void timerCallback() override;
+    
+    // the latency the parameters call for, until the message thread hands it to the host
+    std::atomic<int> pendingLatency { 0 };
+    
+    ParameterSnapshot parameters;
+    double hostSampleRate = 44100.0;
+    int maxBlockSize = 0;
+    int controlPhase = 0; // where the stream is in the current control block
+    
+    static constexpr int maxOversamplingOrder = ProcessingChain<float>::maxOversamplingOrder;
+    
+    CrossfadingChains<float> floatChains;
+    CrossfadingChains<double> doubleChains;
+    
+    std::array<BandControls, 3> bands;
+    BandControls& lowBand = bands[0];
+    BandControls& midBand = bands[1];
+    BandControls& highBand = bands[2];
+    
+    juce::AudioParameterFloat* lowMidCrossover { nullptr };
+    juce::AudioParameterFloat* midHighCrossover { nullptr };
+    
+    IdleDetector idleDetector;
+    
+    void readParameters(ParameterSnapshot& snapshot) const;
+    void readParameterSnapshot();
+    void writeState(StateFormat::Entries& entries) const;
+    void loadState(const StateFormat::Entries& entries, int numEntries, bool isProgramChange = false);
+    static void mapLegacyParameters(juce::ValueTree& tree);
+    
+    // odd while a state is being loaded; see readParameterSnapshot()
+    std::atomic<uint32_t> stateGeneration { 0 };
+    std::atomic<uint32_t> programChanges { 0 };
+    
+    struct ScopedStateSwap
+    {
+        explicit ScopedStateSwap(std::atomic<uint32_t>& g) : generation(g)  { generation.fetch_add(1, std::memory_order_acq_rel); }
+        ~ScopedStateSwap()                                                  { generation.fetch_add(1, std::memory_order_release); }
+        
+        std::atomic<uint32_t>& generation;
+    };
+    
+    std::vector<juce::RangedAudioParameter*> stateParameters;
+    std::vector<uint32_t> stateParameterHashes;
+    
+    juce::SharedResourcePointer<PresetBank> presetBank;
+    std::atomic<int> currentProgram { 0 };
+    
+    MeterFifo meterFifo;
+    MeterCollector meterCollector;
+    std::atomic<bool> meteringActive { false };
+    bool metering = false; // meteringActive, as seen by the current block
     
-    CompressorBand compressor;
+    StageProfiler stageProfiler;
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HatsOffAudioProcessor)
 };
@@ -0,0 +1,161 @@
+/*
+  ==============================================================================
+
+    Factory and user presets, shared by every instance of the plugin.
+
+  ==============================================================================
+*/
+
+#include "PresetBank.h"
+
+namespace
+{
+struct FactoryValue
+{
+    const char* parameterID;
+    float value;    // plain, as the state stores it; choices by index
+};
+
+struct FactoryPreset
+{
+    const char* name;
+    std::vector<FactoryValue> values;   // anything not listed loads at its default
+};
+
+const std::vector<FactoryPreset>& getFactoryPresets()
+{
+    static const std::vector<FactoryPreset> factoryPresets
+    {
+        { "Init", {} },
+        { "Gentle Hats", { { "Mix", 30.0f },
+                           { "Freq", 40.0f },
+                           { "Ratio High Band", 2.0f },     // 2:1
+                           { "Threshold High Band", -12.0f } } },
+        { "Hats Off", { { "Mix", 100.0f },
+                        { "Freq", 80.0f },
+                        { "Ratio High Band", 4.0f },        // 4:1
+                        { "Threshold High Band", -24.0f },
+                        { "Attack High Band", 5.0f },
+                        { "Release High Band", 120.0f } } },
+        { "Tight Drums", { { "Threshold Low Band", -18.0f },
+                           { "Threshold Mid Band", -18.0f },
+                           { "Threshold High Band", -18.0f },
+                           { "Attack Low Band", 10.0f },
+                           { "Attack Mid Band", 5.0f },
+                           { "Attack High Band", 2.0f },
+                           { "Release Low Band", 150.0f },
+                           { "Release Mid Band", 100.0f },
+                           { "Release High Band", 60.0f },
+                           { "Ratio Low Band", 3.0f },      // 3:1
+                           { "Ratio Mid Band", 4.0f },      // 4:1
+                           { "Ratio High Band", 4.0f } } },
+        { "Clean Lookahead", { { "Lookahead", 5.0f },
+                               { "Oversampling", 2.0f },    // 4x
+                               { "Link Mode", 1.0f } } },   // Max
+        { "Surround Bed", { { "Link Mode", 2.0f },          // Average
+                            { "Mix", 60.0f } } },
+    };
+
+    return factoryPresets;
+}
+}
+
+//==============================================================================
+PresetBank::PresetBank()
+{
+    addFactoryPresets();
+    loadUserPresets();
+}
+
+const PresetBank::Preset& PresetBank::getPreset(int index) const noexcept
+{
+    jassert(juce::isPositiveAndBelow(index, getNumPresets()));
+    return presets[(size_t) index];
+}
+
+juce::File PresetBank::getUserPresetFolder()
+{
+    return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+               .getChildFile("Walnut John")
+               .getChildFile("HatsOff")
+               .getChildFile("Presets");
+}
+
+void PresetBank::addFactoryPresets()
+{
+    for (const auto& factoryPreset : getFactoryPresets())
+    {
+        StateFormat::Entries entries;
+        auto numEntries = 0;
+
+        for (const auto& value : factoryPreset.values)
+            entries[(size_t) numEntries++] = { StateFormat::hashParameterID(value.parameterID), value.value };
+
+        add(factoryPreset.name, entries, numEntries, true);
+    }
+}
+
+void PresetBank::loadUserPresets()
+{
+    auto files = getUserPresetFolder().findChildFiles(juce::File::findFiles, false, juce::String("*") + fileExtension);
+    files.sort();
+
+    for (const auto& file : files)
+    {
+        juce::MemoryBlock data;
+        StateFormat::Entries entries;
+
+        if (! file.loadFileAsData(data))
+            continue;
+
+        // a damaged file is skipped rather than loaded as a half-default preset
+        const auto numEntries = StateFormat::read(data.getData(), (int) data.getSize(), entries);
+
+        if (numEntries >= 0 && ! add(file.getFileNameWithoutExtension(), entries, numEntries, false))
+            break;
+    }
+}
+
+bool PresetBank::saveUserPreset(const juce::String& name, const StateFormat::Entries& entries, int numEntries)
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+
+    const auto fileName = juce::File::createLegalFileName(name.trim());
+
+    if (fileName.isEmpty() || getNumPresets() >= maxPresets)
+        return false;
+
+    const auto folder = getUserPresetFolder();
+
+    if (! folder.createDirectory())
+        return false;
+
+    juce::MemoryBlock data;
+    StateFormat::write(data, entries.data(), numEntries);
+
+    // saving over a name replaces the file, but the old preset stays in the bank
+    // until the next session: a preset is never rewritten while it may be read
+
+    if (! folder.getChildFile(fileName + fileExtension).replaceWithData(data.getData(), data.getSize()))
+        return false;
+
+    return add(fileName, entries, numEntries, false);
+}
+
+bool PresetBank::add(const juce::String& name, const StateFormat::Entries& entries, int numEntries, bool isFactory)
+{
+    const auto index = numPresets.load(std::memory_order_relaxed);
+
+    if (index >= maxPresets)
+        return false;
+
+    auto& preset = presets[(size_t) index];
+    preset.name = name;
+    preset.entries = entries;
+    preset.numEntries = numEntries;
+    preset.isFactory = isFactory;
+
+    // publishes the preset to the readers
+    numPresets.store(index + 1, std::memory_order_release);
+    return true;
+}
@@ -0,0 +1,65 @@
+/*
+  ==============================================================================
+
+    Factory and user presets, shared by every instance of the plugin.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "StateFormat.h"
+
+#include <array>
+#include <atomic>
+
+/*
+ Every preset is held as the StateFormat entries it loads from, so switching
+ program is the same allocation-free loadState() a host's setStateInformation
+ goes through. The factory presets are built from a table in the .cpp and the
+ user presets are read from their files once, when the first instance creates
+ the bank; later instances share it through a juce::SharedResourcePointer.
+
+ The presets live in a fixed array that is only ever appended to, and only on
+ the message thread. A new preset is written before the count that makes it
+ visible is published, so any thread may read the presets below
+ getNumPresets() without taking a lock.
+ */
+class PresetBank
+{
+public:
+    static constexpr int maxPresets = 256;
+
+    struct Preset
+    {
+        juce::String name;
+        StateFormat::Entries entries;
+        int numEntries = 0;
+        bool isFactory = false;
+    };
+
+    PresetBank();
+
+    int getNumPresets() const noexcept  { return numPresets.load(std::memory_order_acquire); }
+
+    // index must be below getNumPresets()
+    const Preset& getPreset(int index) const noexcept;
+
+    // writes the preset to the user folder and adds it to the bank; message thread only
+    bool saveUserPreset(const juce::String& name, const StateFormat::Entries& entries, int numEntries);
+
+    static juce::File getUserPresetFolder();
+    static constexpr const char* fileExtension = ".hatsoff";
+
+private:
+    void addFactoryPresets();
+    void loadUserPresets();
+    bool add(const juce::String& name, const StateFormat::Entries& entries, int numEntries, bool isFactory);
+
+    std::array<Preset, maxPresets> presets;
+    std::atomic<int> numPresets { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PresetBank)
+};
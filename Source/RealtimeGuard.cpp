@@ -0,0 +1,310 @@
+/*
+  ==============================================================================
+
+    Allocation and lock detector for the audio thread.
+
+  ==============================================================================
+*/
+
+#include "RealtimeGuard.h"
+
+#if HATSOFF_REALTIME_CHECKS
+
+#include <JuceHeader.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if JUCE_LINUX
+ #include <dlfcn.h>
+ #include <pthread.h>
+
+ // malloc is interposed below, so these must never need it: the default TLS
+ // model of a shared library can allocate on a thread's first access
+ #define HATSOFF_GUARD_THREAD_LOCAL thread_local __attribute__((tls_model("initial-exec")))
+#else
+ #define HATSOFF_GUARD_THREAD_LOCAL thread_local
+#endif
+
+namespace RealtimeGuard
+{
+namespace
+{
+    // plain ints: no constructors may run inside the allocator
+    HATSOFF_GUARD_THREAD_LOCAL int realtimeDepth = 0;
+    HATSOFF_GUARD_THREAD_LOCAL int reporting = 0;
+
+    std::atomic<int> numViolations { 0 };
+    std::atomic<const char*> lastViolation { "" };
+
+    bool isInRealtimeSection() noexcept
+    {
+        return realtimeDepth > 0 && reporting == 0;
+    }
+
+    void reportViolation(const char* what) noexcept
+    {
+        // the assertion below may log (and so allocate), don't count that too
+        ++reporting;
+        numViolations.fetch_add(1, std::memory_order_relaxed);
+        lastViolation.store(what, std::memory_order_relaxed);
+        jassertfalse; // the audio thread just allocated, freed or blocked
+        --reporting;
+    }
+
+    void checkAllocation(const char* what) noexcept
+    {
+        if (isInRealtimeSection())
+            reportViolation(what);
+    }
+
+   #if JUCE_LINUX
+    /* The C allocator is interposed too (see the end of the file), so the
+       operators below go straight to the real one, or every new would count
+       twice. The real functions are looked up on first use; dlsym may
+       allocate while it does that, and those few requests are served from a
+       static buffer that is never given back.
+     */
+    struct SystemAllocator
+    {
+        void* (*malloc)(std::size_t) = nullptr;
+        void* (*calloc)(std::size_t, std::size_t) = nullptr;
+        void* (*realloc)(void*, std::size_t) = nullptr;
+        void (*free)(void*) = nullptr;
+    };
+
+    SystemAllocator systemAllocator;
+    std::atomic<int> lookupState { 0 }; // 0 not started, 1 under way, 2 done
+    HATSOFF_GUARD_THREAD_LOCAL int lookingUp = 0;
+
+    alignas(std::max_align_t) char bootstrapBuffer[4096];
+    std::atomic<std::size_t> bootstrapUsed { 0 };
+
+    template <typename Function>
+    Function lookUp(const char* name) noexcept
+    {
+        return reinterpret_cast<Function>(dlsym(RTLD_NEXT, name));
+    }
+
+    // false while this thread is the one looking the functions up
+    bool resolveSystemAllocator() noexcept
+    {
+        if (lookupState.load(std::memory_order_acquire) == 2)
+            return true;
+
+        if (lookingUp > 0)
+            return false;
+
+        auto expected = 0;
+
+        if (lookupState.compare_exchange_strong(expected, 1, std::memory_order_acq_rel))
+        {
+            ++lookingUp;
+            systemAllocator.malloc = lookUp<decltype(SystemAllocator::malloc)>("malloc");
+            systemAllocator.calloc = lookUp<decltype(SystemAllocator::calloc)>("calloc");
+            systemAllocator.realloc = lookUp<decltype(SystemAllocator::realloc)>("realloc");
+            systemAllocator.free = lookUp<decltype(SystemAllocator::free)>("free");
+            --lookingUp;
+
+            lookupState.store(2, std::memory_order_release);
+            return true;
+        }
+
+        // another thread got there first, it won't be long
+        while (lookupState.load(std::memory_order_acquire) != 2)
+            sched_yield();
+
+        return true;
+    }
+
+    // zeroed, as the buffer is static and never reused, so it serves calloc as well
+    void* allocateBootstrap(std::size_t size) noexcept
+    {
+        constexpr auto alignment = alignof(std::max_align_t);
+        const auto rounded = (juce::jmax((std::size_t) 1, size) + alignment - 1) & ~(alignment - 1);
+        const auto offset = bootstrapUsed.fetch_add(rounded, std::memory_order_relaxed);
+
+        return offset + rounded <= sizeof(bootstrapBuffer) ? bootstrapBuffer + offset : nullptr;
+    }
+
+    bool isBootstrap(const void* ptr) noexcept
+    {
+        const auto* bytes = static_cast<const char*>(ptr);
+        return bytes >= bootstrapBuffer && bytes < bootstrapBuffer + sizeof(bootstrapBuffer);
+    }
+
+    void* systemMalloc(std::size_t size) noexcept
+    {
+        return resolveSystemAllocator() ? systemAllocator.malloc(size) : allocateBootstrap(size);
+    }
+
+    void systemFree(void* ptr) noexcept
+    {
+        if (! isBootstrap(ptr) && resolveSystemAllocator())
+            systemAllocator.free(ptr);
+    }
+   #else
+    void* systemMalloc(std::size_t size) noexcept   { return std::malloc(size); }
+    void systemFree(void* ptr) noexcept             { std::free(ptr); }
+   #endif
+
+    void* allocate(std::size_t size)
+    {
+        checkAllocation("operator new");
+
+        if (auto* ptr = systemMalloc(size == 0 ? 1 : size))
+            return ptr;
+
+        throw std::bad_alloc();
+    }
+
+    void* allocateAligned(std::size_t size, std::align_val_t alignment)
+    {
+        checkAllocation("operator new (aligned)");
+
+        void* ptr = nullptr;
+
+       #if JUCE_WINDOWS
+        ptr = _aligned_malloc(size == 0 ? 1 : size, (std::size_t) alignment);
+       #else
+        if (posix_memalign(&ptr, juce::jmax(sizeof(void*), (std::size_t) alignment), size == 0 ? 1 : size) != 0)
+            ptr = nullptr;
+       #endif
+
+        if (ptr == nullptr)
+            throw std::bad_alloc();
+
+        return ptr;
+    }
+
+    void release(void* ptr) noexcept
+    {
+        if (ptr != nullptr)
+            checkAllocation("operator delete");
+
+        systemFree(ptr);
+    }
+
+    void releaseAligned(void* ptr) noexcept
+    {
+        if (ptr != nullptr)
+            checkAllocation("operator delete (aligned)");
+
+       #if JUCE_WINDOWS
+        _aligned_free(ptr);
+       #else
+        systemFree(ptr);
+       #endif
+    }
+}
+
+void enterRealtimeSection() noexcept    { ++realtimeDepth; }
+void exitRealtimeSection() noexcept     { --realtimeDepth; }
+
+int getNumViolations() noexcept         { return numViolations.load(); }
+const char* getLastViolation() noexcept { return lastViolation.load(); }
+
+void resetViolations() noexcept
+{
+    numViolations = 0;
+    lastViolation = "";
+}
+}
+
+//==============================================================================
+void* operator new(std::size_t size)                                    { return RealtimeGuard::allocate(size); }
+void* operator new[](std::size_t size)                                  { return RealtimeGuard::allocate(size); }
+void* operator new(std::size_t size, std::align_val_t alignment)        { return RealtimeGuard::allocateAligned(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment)      { return RealtimeGuard::allocateAligned(size, alignment); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    try { return RealtimeGuard::allocate(size); } catch (...) { return nullptr; }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    try { return RealtimeGuard::allocate(size); } catch (...) { return nullptr; }
+}
+
+void operator delete(void* ptr) noexcept                                { RealtimeGuard::release(ptr); }
+void operator delete[](void* ptr) noexcept                              { RealtimeGuard::release(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept                   { RealtimeGuard::release(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept                 { RealtimeGuard::release(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept         { RealtimeGuard::release(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept       { RealtimeGuard::release(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept              { RealtimeGuard::releaseAligned(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept            { RealtimeGuard::releaseAligned(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { RealtimeGuard::releaseAligned(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { RealtimeGuard::releaseAligned(ptr); }
+
+//==============================================================================
+#if JUCE_LINUX
+// Interposes libpthread's lock, which std::mutex and juce::CriticalSection both
+// end up in. A lock that is free costs nothing, but from the audio thread any
+// lock is one that could block, so every call counts. try_lock is left alone.
+extern "C" int pthread_mutex_lock(pthread_mutex_t* mutex)
+{
+    using LockFunction = int (*)(pthread_mutex_t*);
+    static auto realLock = reinterpret_cast<LockFunction>(dlsym(RTLD_NEXT, "pthread_mutex_lock"));
+
+    if (RealtimeGuard::isInRealtimeSection())
+        RealtimeGuard::reportViolation("pthread_mutex_lock");
+
+    return realLock(mutex);
+}
+
+// JUCE's HeapBlock, and anything else written against the C allocator, never
+// goes through operator new, so these are interposed as well
+extern "C" void* malloc(std::size_t size)
+{
+    if (! RealtimeGuard::resolveSystemAllocator())
+        return RealtimeGuard::allocateBootstrap(size);
+
+    RealtimeGuard::checkAllocation("malloc");
+    return RealtimeGuard::systemAllocator.malloc(size);
+}
+
+extern "C" void* calloc(std::size_t count, std::size_t size)
+{
+    if (! RealtimeGuard::resolveSystemAllocator())
+        return RealtimeGuard::allocateBootstrap(count * size);
+
+    RealtimeGuard::checkAllocation("calloc");
+    return RealtimeGuard::systemAllocator.calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, std::size_t size)
+{
+    if (! RealtimeGuard::resolveSystemAllocator())
+        return RealtimeGuard::allocateBootstrap(size);
+
+    RealtimeGuard::checkAllocation("realloc");
+
+    if (! RealtimeGuard::isBootstrap(ptr))
+        return RealtimeGuard::systemAllocator.realloc(ptr, size);
+
+    // the old size isn't known, but it can't run past the end of the buffer
+    const auto available = (std::size_t) (RealtimeGuard::bootstrapBuffer + sizeof(RealtimeGuard::bootstrapBuffer) - static_cast<char*>(ptr));
+    auto* moved = RealtimeGuard::systemAllocator.malloc(size);
+
+    if (moved != nullptr)
+        std::memcpy(moved, ptr, juce::jmin(size, available));
+
+    return moved;
+}
+
+extern "C" void free(void* ptr)
+{
+    if (ptr == nullptr || RealtimeGuard::isBootstrap(ptr))
+        return;
+
+    RealtimeGuard::checkAllocation("free");
+    RealtimeGuard::systemFree(ptr);
+}
+#endif
+
+#endif
@@ -0,0 +1,54 @@
+/*
+  ==============================================================================
+
+    Allocation and lock detector for the audio thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+/*
+ Build with HATSOFF_REALTIME_CHECKS=1 to replace the global allocator (and, on
+ Linux, malloc, calloc, realloc, free and pthread_mutex_lock) with versions that
+ count every allocation, free or blocking lock made while a ScopedRealtimeSection
+ is alive on the calling thread.
+ Debug builds also assert at the offending call, so the debugger stops on it.
+
+ With the flag off (the default) the scope is an empty struct and the counters
+ are constant zero, so processBlock pays nothing for it.
+ */
+#ifndef HATSOFF_REALTIME_CHECKS
+ #define HATSOFF_REALTIME_CHECKS 0
+#endif
+
+namespace RealtimeGuard
+{
+   #if HATSOFF_REALTIME_CHECKS
+    void enterRealtimeSection() noexcept;
+    void exitRealtimeSection() noexcept;
+
+    int getNumViolations() noexcept;
+    const char* getLastViolation() noexcept;
+    void resetViolations() noexcept;
+   #else
+    inline int getNumViolations() noexcept          { return 0; }
+    inline const char* getLastViolation() noexcept  { return ""; }
+    inline void resetViolations() noexcept          {}
+   #endif
+
+    constexpr bool isEnabled() noexcept             { return HATSOFF_REALTIME_CHECKS != 0; }
+
+    struct ScopedRealtimeSection
+    {
+       #if HATSOFF_REALTIME_CHECKS
+        ScopedRealtimeSection() noexcept    { enterRealtimeSection(); }
+        ~ScopedRealtimeSection() noexcept   { exitRealtimeSection(); }
+       #else
+        ScopedRealtimeSection() noexcept    {} // user provided, so an unused scope doesn't warn
+       #endif
+
+        ScopedRealtimeSection(const ScopedRealtimeSection&) = delete;
+        ScopedRealtimeSection& operator=(const ScopedRealtimeSection&) = delete;
+    };
+}
@@ -0,0 +1,271 @@
+/*
+  ==============================================================================
+
+    Per-stage timing of processBlock, for profiling builds.
+
+  ==============================================================================
+*/
+
+#include "StageProfiler.h"
+
+#if HATSOFF_PROFILING
+
+#include <algorithm>
+#include <vector>
+
+#if JUCE_INTEL
+ #if JUCE_MSVC
+  #include <intrin.h>
+ #else
+  #include <x86intrin.h>
+ #endif
+#endif
+
+namespace
+{
+/*
+ Drains every instance's FIFO a few times a second. The time stamp counter
+ runs at a fixed rate on anything recent, but that rate isn't published, so
+ it's measured against the high resolution clock for as long as the thread
+ runs; the first tenth of a second is only spent measuring.
+ */
+class ProfileReader  : private juce::Thread
+{
+public:
+    ProfileReader()  : juce::Thread("HatsOff Profiler")
+    {
+        startThread();
+    }
+
+    ~ProfileReader() override
+    {
+        stopThread(1000);
+    }
+
+    void add(StageProfiler* profiler)
+    {
+        const juce::ScopedLock lock(profilersLock);
+        profilers.push_back(profiler);
+    }
+
+    void remove(StageProfiler* profiler)
+    {
+        const juce::ScopedLock lock(profilersLock);
+        profilers.erase(std::remove(profilers.begin(), profilers.end(), profiler), profilers.end());
+    }
+
+private:
+    void run() override
+    {
+        const auto startTicks = StageProfiler::now();
+        const auto startTime = juce::Time::getHighResolutionTicks();
+
+        while (! threadShouldExit())
+        {
+            wait(100);
+
+            const auto seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTime);
+
+            if (seconds < 0.1)
+                continue;
+
+           #if JUCE_INTEL
+            const auto ticksPerSecond = (double) (StageProfiler::now() - startTicks) / seconds;
+           #else
+            juce::ignoreUnused(startTicks);
+            const auto ticksPerSecond = (double) juce::Time::getHighResolutionTicksPerSecond();
+           #endif
+
+            const juce::ScopedLock lock(profilersLock);
+
+            for (auto* profiler : profilers)
+                profiler->collect(ticksPerSecond);
+        }
+    }
+
+    // a profiler takes this to leave, so it can't go away in the middle of a collect()
+    juce::CriticalSection profilersLock;
+    std::vector<StageProfiler*> profilers;
+};
+}
+
+//==============================================================================
+StageProfiler::StageProfiler()
+{
+    juce::SharedResourcePointer<ProfileReader>()->add(this);
+}
+
+StageProfiler::~StageProfiler()
+{
+    juce::SharedResourcePointer<ProfileReader>()->remove(this);
+}
+
+StageProfiler::Ticks StageProfiler::now() noexcept
+{
+   #if JUCE_INTEL
+    return (Ticks) __rdtsc();
+   #else
+    return (Ticks) juce::Time::getHighResolutionTicks();
+   #endif
+}
+
+void StageProfiler::finishBlock(int numSamples, double sampleRate) noexcept
+{
+    // nobody reading means the block is lost, not that the audio thread waits
+    const auto scope = fifo.write(1);
+
+    if (scope.blockSize1 > 0)
+        records[(size_t) scope.startIndex1] = { blockTicks, numSamples, sampleRate };
+
+    blockTicks.fill(0);
+}
+
+void StageProfiler::collect(double ticksPerSecond)
+{
+    const auto scope = fifo.read(fifo.getNumReady());
+    const auto nanosecondsPerTick = 1.0e9 / ticksPerSecond;
+
+    const juce::ScopedLock lock(histogramLock);
+
+    auto addRecord = [&](const BlockRecord& record)
+    {
+        for (size_t stage = 0; stage < histograms.size(); ++stage)
+        {
+            // a stage that never ran in a block isn't counted for it
+            if (record.ticks[stage] == 0 && stage != (size_t) ProfiledStage::block)
+                continue;
+
+            const auto nanoseconds = (double) record.ticks[stage] * nanosecondsPerTick;
+            auto& histogram = histograms[stage];
+
+            ++histogram.counts[(size_t) Histogram::getBucket((uint64_t) nanoseconds)];
+            ++histogram.numBlocks;
+            histogram.totalNanoseconds += nanoseconds;
+            histogram.maxNanoseconds = juce::jmax(histogram.maxNanoseconds, nanoseconds);
+        }
+
+        const auto blockNanoseconds = (double) record.ticks[(size_t) ProfiledStage::block] * nanosecondsPerTick;
+
+        if (record.sampleRate > 0.0 && blockNanoseconds > 1.0e9 * record.numSamples / record.sampleRate)
+            ++numOverruns;
+    };
+
+    for (auto i = 0; i < scope.blockSize1; ++i)
+        addRecord(records[(size_t) (scope.startIndex1 + i)]);
+
+    for (auto i = 0; i < scope.blockSize2; ++i)
+        addRecord(records[(size_t) (scope.startIndex2 + i)]);
+}
+
+StageProfiler::Summary StageProfiler::getSummary(ProfiledStage stage) const
+{
+    const juce::ScopedLock lock(histogramLock);
+    const auto& histogram = histograms[(size_t) stage];
+
+    Summary summary;
+    summary.numBlocks = histogram.numBlocks;
+
+    if (histogram.numBlocks > 0)
+    {
+        summary.mean = histogram.totalNanoseconds / (double) histogram.numBlocks * 1.0e-3;
+        summary.median = histogram.getPercentile(50.0) * 1.0e-3;
+        summary.p99 = histogram.getPercentile(99.0) * 1.0e-3;
+        summary.max = histogram.maxNanoseconds * 1.0e-3;
+    }
+
+    return summary;
+}
+
+int64_t StageProfiler::getNumOverruns() const
+{
+    const juce::ScopedLock lock(histogramLock);
+    return numOverruns;
+}
+
+void StageProfiler::clear()
+{
+    const juce::ScopedLock lock(histogramLock);
+    histograms = {};
+    numOverruns = 0;
+}
+
+bool StageProfiler::writeDump(const juce::File& file) const
+{
+    juce::String text;
+    text << "HatsOff stage profile, " << juce::Time::getCurrentTime().toISO8601(true) << juce::newLine
+         << "microseconds per block, overruns " << (juce::int64) getNumOverruns() << juce::newLine << juce::newLine
+         << "stage" << juce::String::repeatedString(" ", 11)
+         << "blocks      mean    median       p99       max" << juce::newLine;
+
+    auto column = [](double value) { return juce::String(value, 2).paddedLeft(' ', 10); };
+
+    for (auto i = 0; i < numStages; ++i)
+    {
+        const auto stage = (ProfiledStage) i;
+        const auto summary = getSummary(stage);
+
+        text << juce::String(getStageName(stage)).paddedRight(' ', 14)
+             << juce::String((juce::int64) summary.numBlocks).paddedLeft(' ', 8)
+             << column(summary.mean) << column(summary.median) << column(summary.p99) << column(summary.max) << juce::newLine;
+    }
+
+    // the raw buckets too, so a long tail can be looked at properly
+    text << juce::newLine << "histograms, upper bound in ns: count" << juce::newLine;
+
+    const juce::ScopedLock lock(histogramLock);
+
+    for (auto i = 0; i < numStages; ++i)
+    {
+        text << getStageName((ProfiledStage) i) << ":";
+
+        for (auto bucket = 0; bucket < Histogram::numBuckets; ++bucket)
+            if (const auto count = histograms[(size_t) i].counts[(size_t) bucket]; count > 0)
+                text << " " << juce::String(Histogram::getUpperBound(bucket), 0) << ":" << (juce::int64) count;
+
+        text << juce::newLine;
+    }
+
+    return file.replaceWithText(text);
+}
+
+//==============================================================================
+int StageProfiler::Histogram::getBucket(uint64_t nanoseconds) noexcept
+{
+    if (nanoseconds < 8)
+        return (int) nanoseconds;
+
+    // the octave, then the two bits under the top one
+    auto octave = 63;
+    while ((nanoseconds >> octave) == 0)
+        --octave;
+
+    const auto bucket = 4 * (octave - 1) + (int) ((nanoseconds >> (octave - 2)) & 3);
+    return juce::jmin(bucket, numBuckets - 1);
+}
+
+double StageProfiler::Histogram::getUpperBound(int bucket) noexcept
+{
+    if (bucket < 8)
+        return (double) (bucket + 1);
+
+    const auto octave = bucket / 4 + 1;
+    return (double) ((uint64_t) (5 + bucket % 4) << (octave - 2));
+}
+
+double StageProfiler::Histogram::getPercentile(double percent) const
+{
+    const auto rank = juce::jmax((int64_t) 1, (int64_t) std::ceil(percent / 100.0 * (double) numBlocks));
+    int64_t seen = 0;
+
+    for (auto bucket = 0; bucket < numBuckets; ++bucket)
+    {
+        seen += counts[(size_t) bucket];
+
+        if (seen >= rank)
+            return juce::jmin(getUpperBound(bucket), maxNanoseconds);
+    }
+
+    return maxNanoseconds;
+}
+
+#endif
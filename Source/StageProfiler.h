@@ -0,0 +1,174 @@
+/*
+  ==============================================================================
+
+    Per-stage timing of processBlock, for profiling builds.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <array>
+#include <cstdint>
+
+/*
+ Build with HATSOFF_PROFILING=1 to time every stage of processBlock. The audio
+ thread only reads the cycle counter around each stage and adds up the ticks;
+ at the end of the block it pushes one record with every stage's total into a
+ lock-free FIFO. A background thread, shared by all instances, drains the FIFOs
+ into histograms, which the editor shows and writeDump() writes to a file.
+
+ With the flag off (the default) the profiler and its scopes are empty structs
+ with empty inline members, so processBlock pays nothing for them.
+ */
+#ifndef HATSOFF_PROFILING
+ #define HATSOFF_PROFILING 0
+#endif
+
+enum class ProfiledStage
+{
+    control,        // parameter ramps and coefficient updates
+    oversampling,   // up and down, both ways
+    bands,          // input gain, crossover, band compressors and detector, in one loop
+    gainComputer,   // the detector's block work
+    allpass,        // flip, allpass, dry/wet, output gain and mid/side decode
+    crossfade,      // the program change mix
+    metering,
+    block,          // the whole processBlock, including the above
+    numStages
+};
+
+class StageProfiler
+{
+public:
+    static constexpr int numStages = (int) ProfiledStage::numStages;
+
+    static constexpr bool isEnabled() noexcept          { return HATSOFF_PROFILING != 0; }
+
+    static const char* getStageName(ProfiledStage stage) noexcept
+    {
+        static constexpr const char* names[numStages] { "control", "oversampling", "bands", "gain computer",
+                                                        "allpass", "crossfade", "metering", "block" };
+        return names[(int) stage];
+    }
+
+    // what one stage cost over the blocks seen so far, in microseconds per block
+    struct Summary
+    {
+        int64_t numBlocks = 0;
+        double mean = 0.0, median = 0.0, p99 = 0.0, max = 0.0;
+    };
+
+   #if HATSOFF_PROFILING
+    using Ticks = uint64_t;
+
+    StageProfiler();
+    ~StageProfiler();
+
+    static Ticks now() noexcept;
+
+    // audio thread
+    void add(ProfiledStage stage, Ticks ticks) noexcept     { blockTicks[(size_t) stage] += ticks; }
+    void finishBlock(int numSamples, double sampleRate) noexcept;
+
+    // message thread
+    Summary getSummary(ProfiledStage stage) const;
+    int64_t getNumOverruns() const;     // blocks that took longer than they last
+    void clear();
+    bool writeDump(const juce::File& file) const;
+
+    // the reader thread, moves whatever is in the FIFO into the histograms
+    void collect(double ticksPerSecond);
+   #else
+    void finishBlock(int, double) noexcept {}
+
+    Summary getSummary(ProfiledStage) const                 { return {}; }
+    int64_t getNumOverruns() const                          { return 0; }
+    void clear()                                            {}
+    bool writeDump(const juce::File&) const                 { return false; }
+   #endif
+
+    struct ScopedStage
+    {
+       #if HATSOFF_PROFILING
+        ScopedStage(StageProfiler& p, ProfiledStage s) noexcept  : profiler(p), stage(s), start(now()) {}
+        ~ScopedStage() noexcept                                  { profiler.add(stage, now() - start); }
+
+        StageProfiler& profiler;
+        ProfiledStage stage;
+        Ticks start;
+       #else
+        ScopedStage(StageProfiler&, ProfiledStage) noexcept {} // user provided, so an unused scope doesn't warn
+       #endif
+
+        ScopedStage(const ScopedStage&) = delete;
+        ScopedStage& operator=(const ScopedStage&) = delete;
+    };
+
+    // times the whole block, and hands it to the FIFO when it goes out of scope
+    struct ScopedBlock
+    {
+       #if HATSOFF_PROFILING
+        ScopedBlock(StageProfiler& p, int n, double rate) noexcept  : profiler(p), numSamples(n), sampleRate(rate), start(now()) {}
+
+        ~ScopedBlock() noexcept
+        {
+            profiler.add(ProfiledStage::block, now() - start);
+            profiler.finishBlock(numSamples, sampleRate);
+        }
+
+        StageProfiler& profiler;
+        int numSamples;
+        double sampleRate;
+        Ticks start;
+       #else
+        ScopedBlock(StageProfiler&, int, double) noexcept {}
+       #endif
+
+        ScopedBlock(const ScopedBlock&) = delete;
+        ScopedBlock& operator=(const ScopedBlock&) = delete;
+    };
+
+private:
+   #if HATSOFF_PROFILING
+    struct BlockRecord
+    {
+        std::array<Ticks, numStages> ticks;
+        int numSamples;
+        double sampleRate;
+    };
+
+    /*
+     Four buckets per octave of nanoseconds, so a percentile read off it is
+     at most a quarter over the real one, from a few ns up to minutes.
+     */
+    struct Histogram
+    {
+        static constexpr int numBuckets = 4 * 40;
+
+        static int getBucket(uint64_t nanoseconds) noexcept;
+        static double getUpperBound(int bucket) noexcept;   // in ns
+        double getPercentile(double percent) const;         // in ns
+
+        std::array<int64_t, numBuckets> counts {};
+        int64_t numBlocks = 0;
+        double totalNanoseconds = 0.0;
+        double maxNanoseconds = 0.0;
+    };
+
+    static constexpr int capacity = 1024;   // about 10 s of 512 sample blocks at 48 kHz, the reader drains it far sooner
+
+    std::array<Ticks, numStages> blockTicks {};
+
+    juce::AbstractFifo fifo { capacity + 1 };
+    std::array<BlockRecord, capacity + 1> records;
+
+    juce::CriticalSection histogramLock;    // reader thread against the message thread, never the audio thread
+    std::array<Histogram, numStages> histograms;
+    int64_t numOverruns = 0;
+
+    JUCE_DECLARE_NON_COPYABLE (StageProfiler)
+   #endif
+};
@@ -0,0 +1,117 @@
+/*
+  ==============================================================================
+
+    Compact binary plugin state.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <array>
+#include <cstring>
+
+/*
+ The state is a 16 byte header followed by one (id hash, plain value) pair per
+ parameter:
+
+    char     magic[4]       "HOf1"
+    uint32   version
+    uint32   numParameters
+    uint32   checksum       FNV-1a over the entries
+    Entry    entries[numParameters]
+
+ Everything is in the machine's byte order (little-endian on every platform
+ we ship), so reading it back is a size and checksum check and one memcpy.
+ Values are stored unnormalised, so a parameter whose range changes later
+ still comes back as the same value. Anything that doesn't start with the
+ magic is handed to the old ValueTree reader by the processor.
+ */
+namespace StateFormat
+{
+    constexpr char magic[4] = { 'H', 'O', 'f', '1' };
+    constexpr uint32_t currentVersion = 1;
+    constexpr int maxParameters = 128;
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t numParameters;
+        uint32_t checksum;
+    };
+
+    struct Entry
+    {
+        uint32_t idHash;
+        float value;
+    };
+
+    static_assert(sizeof(Header) == 16 && sizeof(Entry) == 8, "the layout is the file format");
+
+    using Entries = std::array<Entry, maxParameters>;
+
+    inline uint32_t hashParameterID(const juce::String& id)
+    {
+        // String::hashCode is a fixed algorithm, so the hash is stable across builds
+        return (uint32_t) id.hashCode();
+    }
+
+    inline uint32_t calculateChecksum(const Entry* entries, int numEntries) noexcept
+    {
+        auto hash = 2166136261u;
+        const auto* bytes = reinterpret_cast<const uint8_t*>(entries);
+
+        for (size_t i = 0; i < (size_t) numEntries * sizeof(Entry); ++i)
+            hash = (hash ^ bytes[i]) * 16777619u;
+
+        return hash;
+    }
+
+    inline bool hasMagic(const void* data, int sizeInBytes) noexcept
+    {
+        return data != nullptr && sizeInBytes >= (int) sizeof(Header)
+            && std::memcmp(data, magic, sizeof(magic)) == 0;
+    }
+
+    inline void write(juce::MemoryBlock& destination, const Entry* entries, int numEntries)
+    {
+        jassert(numEntries <= maxParameters);
+
+        Header header;
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = currentVersion;
+        header.numParameters = (uint32_t) numEntries;
+        header.checksum = calculateChecksum(entries, numEntries);
+
+        destination.setSize(sizeof(Header) + (size_t) numEntries * sizeof(Entry));
+        destination.copyFrom(&header, 0, sizeof(Header));
+        destination.copyFrom(entries, (int) sizeof(Header), (size_t) numEntries * sizeof(Entry));
+    }
+
+    // the number of entries copied into `entries`, or -1 if the data isn't a valid state
+    inline int read(const void* data, int sizeInBytes, Entries& entries) noexcept
+    {
+        if (! hasMagic(data, sizeInBytes))
+            return -1;
+
+        Header header;
+        std::memcpy(&header, data, sizeof(Header));
+
+        const auto numEntries = (int) header.numParameters;
+
+        if (header.version == 0 || header.version > currentVersion
+            || numEntries > maxParameters
+            || (size_t) sizeInBytes != sizeof(Header) + (size_t) numEntries * sizeof(Entry))
+            return -1;
+
+        std::memcpy(entries.data(), static_cast<const char*>(data) + sizeof(Header), (size_t) numEntries * sizeof(Entry));
+
+        if (calculateChecksum(entries.data(), numEntries) != header.checksum)
+            return -1;
+
+        return numEntries;
+    }
+}
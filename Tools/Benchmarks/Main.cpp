@@ -0,0 +1,782 @@
+/*
+  ==============================================================================
+
+    HatsOffBenchmarks - timings for the DSP kernels, outside of any host.
+
+    Sweeps every combination of block size, channel count and sample rate and
+    times, for each one:
+     - the gain computer's smoothing and the allpass stage, once with the
+       channels side by side in SIMD lanes and once with the plain
+       per-channel loop,
+     - one CompressorBand, fed sample by sample the way the crossover loop
+       feeds it and through its whole-buffer process(),
+     - the gain computer and the CompressorBand again, with exact and with
+       fast math (see FastMath.h),
+     - the whole processBlock, once per parameter configuration (--configs).
+    Paths that should produce the same output are checked against each other
+    and the largest difference is reported with the timings.
+
+    Then times one instance recalling its state from the binary format and
+    from the ValueTree format older sessions used, as a host does for every
+    instance when a session opens.
+
+    Each case runs for about --samples-per-case samples per channel, so small
+    blocks get more iterations than big ones. The table goes to stdout;
+    --format=csv|json writes the same results in a form scripts can diff
+    between releases, to --output if given and to stdout instead of the table
+    otherwise.
+
+    HatsOffBenchmarks [--block-sizes=16,64,256,1024,4096] [--channels=1,2,6,8,12]
+                      [--sample-rates=44100,48000,96000]
+                      [--configs=default,lookahead,mid-side,oversampled,heavy,fast,
+                                 rms,true-peak]
+                      [--samples-per-case=262144] [--state-iterations=200]
+                      [--format=table|csv|json] [--output=results.json]
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+
+#include "AllpassStage.h"
+#include "CompressorBand.h"
+#include "GainComputer.h"
+#include "ParameterSnapshot.h"
+#include "PluginProcessor.h"
+#include "BlockTimingStats.h"
+#include "ProcessorSetup.h"
+
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace
+{
+// plain parameter values on top of the defaults, for the processBlock runs
+struct ProcessorConfig
+{
+    const char* name;
+    std::vector<std::pair<const char*, float>> parameters;
+};
+
+/* The bypassed configs show what bypass saves over "default": only each
+   bypassed band's detector, envelope and gain. The crossover, the shared
+   lookahead delay, the per-sample band loop and the hat detector still run for
+   all three bands, since a bypassed band is still split off and summed back,
+   so the cost doesn't fall in proportion to the bands bypassed.
+ */
+const std::vector<ProcessorConfig>& getProcessorConfigs()
+{
+    static const std::vector<ProcessorConfig> configs
+    {
+        { "default",      {} },
+        { "two-bypassed", { { "Bypassed Low Band", 1.0f }, { "Bypassed Mid Band", 1.0f } } },
+        { "all-bypassed", { { "Bypassed Low Band", 1.0f }, { "Bypassed Mid Band", 1.0f },
+                            { "Bypassed High Band", 1.0f } } },
+        { "lookahead",    { { "Lookahead", 5.0f } } },
+        { "mid-side",     { { "Link Mode", 3.0f } } },
+        { "oversampled",  { { "Oversampling", 2.0f } } },   // 4x
+        { "heavy",        { { "Lookahead", 5.0f }, { "Oversampling", 2.0f }, { "Link Mode", 1.0f },
+                            { "Threshold Low Band", -30.0f }, { "Threshold Mid Band", -30.0f },
+                            { "Threshold High Band", -30.0f }, { "Mix", 50.0f } } },
+        { "fast",         { { "Precision", 1.0f } } },
+        { "rms",          { { "Detector", 1.0f } } },
+        { "true-peak",    { { "Detector", 2.0f } } },
+    };
+
+    return configs;
+}
+
+const ProcessorConfig* findProcessorConfig(const juce::String& name)
+{
+    for (auto& config : getProcessorConfigs())
+        if (name == config.name)
+            return &config;
+
+    return nullptr;
+}
+
+enum class OutputFormat { table, csv, json };
+
+struct BenchmarkSettings
+{
+    juce::Array<int> blockSizes { 16, 64, 256, 1024, 4096 };
+    juce::Array<int> channelCounts { 1, 2, 6, 8, 12 };
+    juce::Array<double> sampleRates { 44100.0, 48000.0, 96000.0 };
+    juce::StringArray configs { "default", "two-bypassed", "all-bypassed", "lookahead", "mid-side",
+                                 "oversampled", "heavy", "fast", "rms", "true-peak" };
+    int samplesPerCase = 1 << 18;
+    int stateIterations = 200;
+    OutputFormat format = OutputFormat::table;
+    juce::File output;
+
+    int getIterations(int blockSize) const
+    {
+        return juce::jlimit(minIterations, maxIterations, samplesPerCase / blockSize);
+    }
+
+    static constexpr int minIterations = 20;
+    static constexpr int maxIterations = 20000;
+};
+
+void printUsage()
+{
+    std::cout << "Usage: HatsOffBenchmarks [--block-sizes=16,64,256,1024,4096] [--channels=1,2,6,8,12]" << std::endl
+              << "                         [--sample-rates=44100,48000,96000]" << std::endl
+              << "                         [--configs=default,two-bypassed,all-bypassed,lookahead,mid-side," << std::endl
+              << "                                    oversampled,heavy,fast,rms,true-peak]" << std::endl
+              << "                         [--samples-per-case=262144] [--state-iterations=200]" << std::endl
+              << "                         [--format=table|csv|json] [--output=results.json]" << std::endl;
+}
+
+// a comma separated option, left as it is when absent; false if any value isn't positive
+template <typename ValueType>
+bool parseList(const juce::ArgumentList& args, const juce::String& option, juce::Array<ValueType>& values)
+{
+    if (! args.containsOption(option))
+        return true;
+
+    values.clear();
+
+    for (auto& token : juce::StringArray::fromTokens(args.getValueForOption(option), ",", {}))
+    {
+        const auto value = (ValueType) token.trim().getDoubleValue();
+
+        if (value <= ValueType(0))
+            return false;
+
+        values.add(value);
+    }
+
+    return ! values.isEmpty();
+}
+
+bool parseSettings(const juce::ArgumentList& args, BenchmarkSettings& settings)
+{
+    if (args.containsOption("--help|-h"))
+        return false;
+
+    if (! parseList(args, "--block-sizes", settings.blockSizes)
+        || ! parseList(args, "--channels", settings.channelCounts)
+        || ! parseList(args, "--sample-rates", settings.sampleRates))
+        return false;
+
+    if (args.containsOption("--samples-per-case"))
+        settings.samplesPerCase = args.getValueForOption("--samples-per-case").getIntValue();
+
+    if (args.containsOption("--state-iterations"))
+        settings.stateIterations = args.getValueForOption("--state-iterations").getIntValue();
+
+    if (args.containsOption("--configs"))
+    {
+        settings.configs = juce::StringArray::fromTokens(args.getValueForOption("--configs"), ",", {});
+        settings.configs.trim();
+        settings.configs.removeEmptyStrings();
+
+        for (auto& name : settings.configs)
+            if (findProcessorConfig(name) == nullptr)
+                return false;
+    }
+
+    if (args.containsOption("--format"))
+    {
+        const auto format = args.getValueForOption("--format").toLowerCase();
+
+        if (format == "csv")
+            settings.format = OutputFormat::csv;
+        else if (format == "json")
+            settings.format = OutputFormat::json;
+        else if (format != "table")
+            return false;
+    }
+
+    if (args.containsOption("--output"))
+        settings.output = args.getFileForOption("--output");
+
+    return settings.samplesPerCase > 0 && settings.stateIterations > 0;
+}
+
+//==============================================================================
+/*
+ One timed case. Times are per channel-sample, so block sizes and channel
+ counts can be compared directly; the block median is there for checking
+ against a deadline. baselineNanoseconds is the per-channel loop's median
+ when this is the SIMD lanes variant of the same case.
+ */
+struct Record
+{
+    juce::String kernel, variant;
+    double sampleRate = 0.0;
+    int blockSize = 0;
+    int numChannels = 0;
+    int iterations = 0;
+    double medianNanoseconds = 0.0;
+    double p99Nanoseconds = 0.0;
+    double blockMedianMicroseconds = 0.0;
+    double baselineNanoseconds = 0.0;
+    float difference = 0.0f;
+};
+
+class Results
+{
+public:
+    explicit Results(const BenchmarkSettings& s)  : settings(s) {}
+
+    void add(const Record& record)
+    {
+        records.push_back(record);
+
+        if (settings.format == OutputFormat::table || settings.output != juce::File())
+            printRow(record);
+    }
+
+    void printHeader() const
+    {
+        if (settings.format != OutputFormat::table && settings.output == juce::File())
+            return;
+
+        std::cout << ChannelLanes::lanes<float> << " lanes, ns per channel-sample" << std::endl
+                  << std::left << std::setw(16) << "kernel"
+                  << std::setw(13) << "variant"
+                  << std::right << std::setw(8) << "rate"
+                  << std::setw(7) << "block"
+                  << std::setw(9) << "channels"
+                  << std::setw(11) << "median"
+                  << std::setw(11) << "p99"
+                  << std::setw(10) << "speedup"
+                  << std::setw(11) << "max diff" << std::endl;
+    }
+
+    // false if the output file couldn't be written
+    bool write() const
+    {
+        if (settings.format == OutputFormat::table)
+            return true;
+
+        const auto text = settings.format == OutputFormat::csv ? toCsv() : toJson();
+
+        if (settings.output == juce::File())
+        {
+            std::cout << text << std::endl;
+            return true;
+        }
+
+        return settings.output.replaceWithText(text);
+    }
+
+private:
+    static void printRow(const Record& record)
+    {
+        std::cout << std::left << std::setw(16) << record.kernel
+                  << std::setw(13) << record.variant
+                  << std::right << std::setw(8) << record.sampleRate
+                  << std::setw(7) << record.blockSize
+                  << std::setw(9) << record.numChannels
+                  << std::fixed << std::setprecision(3)
+                  << std::setw(11) << record.medianNanoseconds
+                  << std::setw(11) << record.p99Nanoseconds;
+
+        if (record.baselineNanoseconds > 0.0 && record.medianNanoseconds > 0.0)
+            std::cout << std::setw(9) << std::setprecision(2) << record.baselineNanoseconds / record.medianNanoseconds << "x";
+        else
+            std::cout << std::setw(10) << "";
+
+        std::cout << std::setw(11) << std::scientific << std::setprecision(1) << record.difference
+                  << std::defaultfloat << std::endl;
+    }
+
+    juce::String toCsv() const
+    {
+        juce::StringArray lines { "kernel,variant,sample_rate,block_size,channels,iterations,"
+                                  "median_ns,p99_ns,block_median_us,baseline_ns,max_diff" };
+
+        for (auto& record : records)
+            lines.add(juce::StringArray { record.kernel,
+                                          record.variant,
+                                          juce::String(record.sampleRate),
+                                          juce::String(record.blockSize),
+                                          juce::String(record.numChannels),
+                                          juce::String(record.iterations),
+                                          juce::String(record.medianNanoseconds, 4),
+                                          juce::String(record.p99Nanoseconds, 4),
+                                          juce::String(record.blockMedianMicroseconds, 4),
+                                          juce::String(record.baselineNanoseconds, 4),
+                                          juce::String(record.difference) }.joinIntoString(","));
+
+        return lines.joinIntoString("\n");
+    }
+
+    // the machine and build go in with the results, so runs from different boxes aren't compared by mistake
+    juce::String toJson() const
+    {
+        juce::Array<juce::var> list;
+
+        for (auto& record : records)
+        {
+            auto* object = new juce::DynamicObject();
+            object->setProperty("kernel", record.kernel);
+            object->setProperty("variant", record.variant);
+            object->setProperty("sample_rate", record.sampleRate);
+            object->setProperty("block_size", record.blockSize);
+            object->setProperty("channels", record.numChannels);
+            object->setProperty("iterations", record.iterations);
+            object->setProperty("median_ns", record.medianNanoseconds);
+            object->setProperty("p99_ns", record.p99Nanoseconds);
+            object->setProperty("block_median_us", record.blockMedianMicroseconds);
+            object->setProperty("baseline_ns", record.baselineNanoseconds);
+            object->setProperty("max_diff", record.difference);
+            list.add(juce::var(object));
+        }
+
+        auto* root = new juce::DynamicObject();
+        root->setProperty("version", ProjectInfo::versionString);
+        root->setProperty("date", juce::Time::getCurrentTime().toISO8601(true));
+        root->setProperty("os", juce::SystemStats::getOperatingSystemName());
+        root->setProperty("cpu", juce::SystemStats::getCpuModel());
+        root->setProperty("lanes", (int) ChannelLanes::lanes<float>);
+        root->setProperty("results", list);
+
+        return juce::JSON::toString(juce::var(root));
+    }
+
+    const BenchmarkSettings& settings;
+    std::vector<Record> records;
+};
+
+//==============================================================================
+// A few channels of noise bursts, so the detector both attacks and releases.
+juce::AudioBuffer<float> makeSource(int numChannels, int numSamples)
+{
+    juce::AudioBuffer<float> source(numChannels, numSamples);
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+
+    for (auto channel = 0; channel < numChannels; ++channel)
+    {
+        auto envelope = 1.0f;
+
+        for (auto i = 0; i < numSamples; ++i)
+        {
+            envelope = noise(random) > 0.99f ? 1.0f : envelope * 0.995f;
+            source.setSample(channel, i, noise(random) * envelope);
+        }
+    }
+
+    return source;
+}
+
+juce::dsp::AudioBlock<float> restore(juce::AudioBuffer<float>& work, const juce::AudioBuffer<float>& source)
+{
+    for (auto channel = 0; channel < work.getNumChannels(); ++channel)
+        work.copyFrom(channel, 0, source, channel, 0, work.getNumSamples());
+
+    return juce::dsp::AudioBlock<float>(work);
+}
+
+float maxDifference(const juce::AudioBuffer<float>& a, const juce::AudioBuffer<float>& b)
+{
+    auto difference = 0.0f;
+
+    for (auto channel = 0; channel < a.getNumChannels(); ++channel)
+        for (auto i = 0; i < a.getNumSamples(); ++i)
+            difference = juce::jmax(difference, std::abs(a.getSample(channel, i) - b.getSample(channel, i)));
+
+    return difference;
+}
+
+struct Case
+{
+    double sampleRate;
+    int blockSize;
+    int numChannels;
+    int iterations;
+};
+
+Record makeRecord(const char* kernel, const char* variant, const Case& c)
+{
+    Record record;
+    record.kernel = kernel;
+    record.variant = variant;
+    record.sampleRate = c.sampleRate;
+    record.blockSize = c.blockSize;
+    record.numChannels = c.numChannels;
+    record.iterations = c.iterations;
+    return record;
+}
+
+// calls prepareIteration() untimed and process() timed, and fills in the record's times
+template <typename PrepareIteration, typename Process>
+void timeCase(Record& record, PrepareIteration&& prepareIteration, Process&& process)
+{
+    BlockTimingStats stats;
+    stats.reserve((size_t) record.iterations);
+
+    for (auto iteration = 0; iteration < record.iterations; ++iteration)
+    {
+        prepareIteration();
+
+        auto begin = BlockTimingStats::Clock::now();
+        process();
+        auto end = BlockTimingStats::Clock::now();
+
+        stats.add(BlockTimingStats::secondsBetween(begin, end));
+    }
+
+    // the median is the least disturbed by the scheduler
+    const auto toNanosecondsPerSample = 1.0e9 / (double) (record.blockSize * record.numChannels);
+
+    record.medianNanoseconds = stats.getPercentile(50.0) * toNanosecondsPerSample;
+    record.p99Nanoseconds = stats.getPercentile(99.0) * toNanosecondsPerSample;
+    record.blockMedianMicroseconds = stats.getPercentile(50.0) * 1.0e6;
+}
+
+// runs `process` on two set ups of the same stage, and times both; the second is compared with the first
+template <typename Stage, typename Process>
+void compareVariants(Results& results, const char* kernel, const Case& c,
+                     const char* baselineName, Stage& baseline, const char* variantName, Stage& variant, Process&& process)
+{
+    auto source = makeSource(c.numChannels, c.blockSize);
+    juce::AudioBuffer<float> baselineOutput(c.numChannels, c.blockSize);
+    juce::AudioBuffer<float> variantOutput(c.numChannels, c.blockSize);
+
+    auto baselineBlock = restore(baselineOutput, source);
+    auto variantBlock = restore(variantOutput, source);
+    process(baseline, baselineBlock);
+    process(variant, variantBlock);
+    const auto difference = maxDifference(baselineOutput, variantOutput);
+
+    auto run = [&](const char* name, Stage& stage, juce::AudioBuffer<float>& work)
+    {
+        auto record = makeRecord(kernel, name, c);
+        record.difference = difference;
+        juce::dsp::AudioBlock<float> block;
+
+        timeCase(record, [&] { block = restore(work, source); }, [&] { process(stage, block); });
+        return record;
+    };
+
+    const auto baselineRecord = run(baselineName, baseline, baselineOutput);
+    auto variantRecord = run(variantName, variant, variantOutput);
+    variantRecord.baselineNanoseconds = baselineRecord.medianNanoseconds;
+
+    results.add(baselineRecord);
+    results.add(variantRecord);
+}
+
+// the lanes against the per-channel loop
+template <typename Stage, typename Process>
+void compareLanes(Results& results, const char* kernel, const Case& c, Stage& lanes, Stage& perChannel, Process&& process)
+{
+    lanes.setChannelLanesEnabled(true);
+    perChannel.setChannelLanesEnabled(false);
+
+    compareVariants(results, kernel, c, "per-channel", perChannel, "lanes", lanes, std::forward<Process>(process));
+}
+
+// the detector's output is its gain rows, copied back over the block so they can be compared
+void processGainComputer(GainComputer<float>& detector, juce::dsp::AudioBlock<float>& block)
+{
+    detector.process(block);
+
+    for (size_t channel = 0; channel < block.getNumChannels(); ++channel)
+        juce::FloatVectorOperations::copy(block.getChannelPointer(channel),
+                                          detector.getGains((int) channel),
+                                          (int) block.getNumSamples());
+}
+
+void prepareGainComputer(GainComputer<float>& detector, const Case& c)
+{
+    detector.prepare(c.sampleRate, c.blockSize, c.numChannels);
+    detector.setAttack(0.001f);
+    detector.setRelease(0.05f);
+}
+
+void benchmarkGainComputer(Results& results, const Case& c)
+{
+    GainComputer<float> lanes, perChannel;
+
+    for (auto* detector : { &lanes, &perChannel })
+        prepareGainComputer(*detector, c);
+
+    compareLanes(results, "gain computer", c, lanes, perChannel, processGainComputer);
+}
+
+void benchmarkAllpass(Results& results, const Case& c)
+{
+    GainComputer<float> gains;
+    gains.prepare(c.sampleRate, c.blockSize, c.numChannels);
+    auto source = makeSource(c.numChannels, c.blockSize);
+    juce::dsp::AudioBlock<float> sourceBlock(source);
+    gains.process(sourceBlock);
+
+    AllpassStage<float> lanes, perChannel;
+
+    for (auto* stage : { &lanes, &perChannel })
+    {
+        stage->prepare(c.numChannels, c.blockSize);
+        stage->setCoefficient((float) calculateAllpassCoefficient(50.0f, c.sampleRate));
+        stage->setMix(0.5f);
+    }
+
+    compareLanes(results, "allpass", c, lanes, perChannel,
+                 [&gains](AllpassStage<float>& stage, juce::dsp::AudioBlock<float>& block)
+                 {
+                     stage.process(block, gains.getGainRows());
+                 });
+}
+
+// the per-sample entry point the crossover loop uses, against the whole-buffer one
+void benchmarkCompressorBand(Results& results, const Case& c)
+{
+    BandParameters parameters;
+    parameters.thresholdDb = -24.0f;
+    parameters.attackMs = 5.0f;
+    parameters.releaseMs = 100.0f;
+    parameters.ratio = 4.0f;
+
+    const auto lookaheadSamples = juce::roundToInt(0.005 * c.sampleRate);
+    CompressorBand<float> perSample, wholeBuffer;
+
+    for (auto* band : { &perSample, &wholeBuffer })
+    {
+        band->prepare({ c.sampleRate, (juce::uint32) c.blockSize, (juce::uint32) c.numChannels }, lookaheadSamples);
+        band->setLookahead(lookaheadSamples);
+        band->updateCompressorSettings(parameters);
+    }
+
+    auto source = makeSource(c.numChannels, c.blockSize);
+    juce::AudioBuffer<float> perSampleOutput(c.numChannels, c.blockSize);
+    juce::AudioBuffer<float> wholeBufferOutput(c.numChannels, c.blockSize);
+
+    auto processPerSample = [&]
+    {
+        perSample.startBlock(c.blockSize);
+
+        for (auto i = 0; i < c.blockSize; ++i)
+            for (auto channel = 0; channel < c.numChannels; ++channel)
+                perSampleOutput.setSample(channel, i, perSample.processSample(channel, i, perSampleOutput.getSample(channel, i)));
+    };
+
+    restore(perSampleOutput, source);
+    restore(wholeBufferOutput, source);
+    processPerSample();
+    wholeBuffer.process(wholeBufferOutput);
+    const auto difference = maxDifference(perSampleOutput, wholeBufferOutput);
+
+    auto perSampleRecord = makeRecord("compressor band", "per-sample", c);
+    auto wholeBufferRecord = makeRecord("compressor band", "buffer", c);
+    perSampleRecord.difference = wholeBufferRecord.difference = difference;
+
+    timeCase(perSampleRecord, [&] { restore(perSampleOutput, source); }, processPerSample);
+    timeCase(wholeBufferRecord, [&] { restore(wholeBufferOutput, source); }, [&] { wholeBuffer.process(wholeBufferOutput); });
+
+    results.add(perSampleRecord);
+    results.add(wholeBufferRecord);
+}
+
+// the log/exp work of the detectors, from the standard library and from FastMath
+void benchmarkPrecision(Results& results, const Case& c)
+{
+    GainComputer<float> exactDetector, fastDetector;
+
+    for (auto* detector : { &exactDetector, &fastDetector })
+        prepareGainComputer(*detector, c);
+
+    fastDetector.setPrecision(MathPrecision::fast);
+    compareVariants(results, "detector math", c, "exact", exactDetector, "fast", fastDetector, processGainComputer);
+
+    BandParameters parameters;
+    parameters.thresholdDb = -24.0f;
+    parameters.attackMs = 5.0f;
+    parameters.releaseMs = 100.0f;
+    parameters.ratio = 4.0f;
+
+    CompressorBand<float> exactBand, fastBand;
+
+    for (auto* band : { &exactBand, &fastBand })
+    {
+        band->prepare({ c.sampleRate, (juce::uint32) c.blockSize, (juce::uint32) c.numChannels });
+        band->updateCompressorSettings(parameters);
+    }
+
+    fastBand.setPrecision(MathPrecision::fast);
+    compareVariants(results, "band math", c, "exact", exactBand, "fast", fastBand,
+                    [&c](CompressorBand<float>& band, juce::dsp::AudioBlock<float>& block)
+                    {
+                        band.startBlock(c.blockSize);
+
+                        for (size_t channel = 0; channel < block.getNumChannels(); ++channel)
+                        {
+                            auto* data = block.getChannelPointer(channel);
+
+                            for (auto i = 0; i < c.blockSize; ++i)
+                                data[i] = band.processSample((int) channel, i, data[i]);
+                        }
+                    });
+}
+
+// the whole plugin, through processBlock, walking through a second of source audio
+void benchmarkProcessBlock(Results& results, const Case& c, const ProcessorConfig& config)
+{
+    HatsOffAudioProcessor processor;
+    processor.setIdleDetectionEnabled(false);
+
+    for (auto& [id, value] : config.parameters)
+        ProcessorSetup::setParameter(processor, id, value);
+
+    if (! ProcessorSetup::prepare(processor, c.numChannels, c.sampleRate, c.blockSize))
+    {
+        std::cerr << "skipping processBlock with " << c.numChannels << " channels, not a supported layout" << std::endl;
+        return;
+    }
+
+    const auto sourceLength = juce::jmax(c.blockSize, juce::roundToInt(c.sampleRate));
+    auto source = makeSource(c.numChannels, sourceLength);
+    juce::AudioBuffer<float> block(c.numChannels, c.blockSize);
+    juce::MidiBuffer midi;
+    auto position = 0;
+
+    auto nextBlock = [&]
+    {
+        if (position + c.blockSize > sourceLength)
+            position = 0;
+
+        for (auto channel = 0; channel < c.numChannels; ++channel)
+            block.copyFrom(channel, 0, source, channel, position, c.blockSize);
+
+        position += c.blockSize;
+    };
+
+    // long enough for the parameter ramps to settle
+    const auto numWarmupBlocks = (int) std::ceil(0.1 * c.sampleRate / c.blockSize);
+
+    for (auto i = 0; i < numWarmupBlocks; ++i)
+    {
+        nextBlock();
+        processor.processBlock(block, midi);
+    }
+
+    auto record = makeRecord("processBlock", config.name, c);
+    timeCase(record, nextBlock, [&] { processor.processBlock(block, midi); });
+    results.add(record);
+
+    processor.releaseResources();
+}
+
+int runBenchmarks(const BenchmarkSettings& settings, Results& results)
+{
+    juce::ScopedNoDenormals noDenormals;
+
+    results.printHeader();
+
+    for (auto sampleRate : settings.sampleRates)
+    {
+        for (auto blockSize : settings.blockSizes)
+        {
+            for (auto numChannels : settings.channelCounts)
+            {
+                const Case c { sampleRate, blockSize, numChannels, settings.getIterations(blockSize) };
+
+                benchmarkGainComputer(results, c);
+                benchmarkAllpass(results, c);
+                benchmarkCompressorBand(results, c);
+                benchmarkPrecision(results, c);
+
+                for (auto& name : settings.configs)
+                    benchmarkProcessBlock(results, c, *findProcessorConfig(name));
+            }
+        }
+    }
+
+    return 0;
+}
+
+float maxParameterDifference(HatsOffAudioProcessor& a, HatsOffAudioProcessor& b)
+{
+    auto difference = 0.0f;
+    const auto& parametersA = a.getParameters();
+    const auto& parametersB = b.getParameters();
+
+    for (auto i = 0; i < parametersA.size(); ++i)
+        difference = juce::jmax(difference, std::abs(parametersA[i]->getValue() - parametersB[i]->getValue()));
+
+    return difference;
+}
+
+// setStateInformation on an instance at its defaults, as when a session opens
+int runStateBenchmark(const BenchmarkSettings& settings, Results& results)
+{
+    HatsOffAudioProcessor source;
+    std::mt19937 random(99);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    for (auto* parameter : source.getParameters())
+        parameter->setValueNotifyingHost(uniform(random));
+
+    juce::MemoryBlock binaryState;
+    source.getStateInformation(binaryState);
+
+    juce::MemoryBlock valueTreeState;
+    {
+        juce::MemoryOutputStream stream(valueTreeState, false);
+        source.apvts.copyState().writeToStream(stream);
+    }
+
+    for (auto* format : { "binary", "valuetree" })
+    {
+        const auto& state = std::strcmp(format, "binary") == 0 ? binaryState : valueTreeState;
+        HatsOffAudioProcessor destination;
+
+        // one "block" is one instance, so the per-sample times are per instance too
+        Record record;
+        record.kernel = "state recall";
+        record.variant = format;
+        record.blockSize = 1;
+        record.numChannels = 1;
+        record.iterations = settings.stateIterations;
+
+        timeCase(record,
+             [&] { ProcessorSetup::resetToDefaults(destination); },
+             [&] { destination.setStateInformation(state.getData(), (int) state.getSize()); });
+
+        record.difference = maxParameterDifference(source, destination);
+        results.add(record);
+    }
+
+    return 0;
+}
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::ArgumentList args(argc, argv);
+    BenchmarkSettings settings;
+
+    if (! parseSettings(args, settings))
+    {
+        printUsage();
+        return 1;
+    }
+
+    Results results(settings);
+
+    if (auto result = runBenchmarks(settings, results); result != 0)
+        return result;
+
+    if (auto result = runStateBenchmark(settings, results); result != 0)
+        return result;
+
+    if (! results.write())
+    {
+        std::cerr << "Could not write " << settings.output.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,80 @@
+/*
+  ==============================================================================
+
+    Per-block timing statistics shared by the headless tools.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+struct BlockTimingStats
+{
+    using Clock = std::chrono::steady_clock;
+
+    void reserve(size_t numBlocks)
+    {
+        blockSeconds.reserve(numBlocks);
+    }
+
+    void clear()
+    {
+        blockSeconds.clear();
+        sorted = false;
+    }
+
+    void add(double seconds)
+    {
+        blockSeconds.push_back(seconds);
+        sorted = false;
+    }
+
+    static double secondsBetween(Clock::time_point start, Clock::time_point end)
+    {
+        return std::chrono::duration<double>(end - start).count();
+    }
+
+    size_t getNumBlocks() const { return blockSeconds.size(); }
+
+    double getTotal() const
+    {
+        double total = 0.0;
+        for (auto s : blockSeconds)
+            total += s;
+        return total;
+    }
+
+    double getMean() const
+    {
+        return blockSeconds.empty() ? 0.0 : getTotal() / (double) blockSeconds.size();
+    }
+
+    double getMin()                 { return getPercentile(0.0); }
+    double getMax()                 { return getPercentile(100.0); }
+
+    double getPercentile(double percent)
+    {
+        if (blockSeconds.empty())
+            return 0.0;
+
+        if (! sorted)
+        {
+            std::sort(blockSeconds.begin(), blockSeconds.end());
+            sorted = true;
+        }
+
+        auto index = (size_t) std::ceil(percent / 100.0 * (double) blockSeconds.size());
+        index = juce::jlimit((size_t) 1, blockSeconds.size(), index);
+        return blockSeconds[index - 1];
+    }
+
+private:
+    std::vector<double> blockSeconds;
+    bool sorted = false;
+};
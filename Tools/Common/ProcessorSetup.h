@@ -0,0 +1,67 @@
+/*
+  ==============================================================================
+
+    Setting up a HatsOffAudioProcessor the way a host would, for the tools.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "PluginProcessor.h"
+
+namespace ProcessorSetup
+{
+    // values are plain (dB, ms, choice index), not normalised
+    inline bool setParameter(HatsOffAudioProcessor& processor, const juce::String& parameterID, float value)
+    {
+        auto* parameter = processor.apvts.getParameter(parameterID);
+
+        if (parameter == nullptr)
+            return false;
+
+        parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+        return true;
+    }
+
+    inline void resetToDefaults(HatsOffAudioProcessor& processor)
+    {
+        for (auto* parameter : processor.getParameters())
+            parameter->setValueNotifyingHost(parameter->getDefaultValue());
+    }
+
+    // the speaker layout a stem with that many channels would use, so the LFE is known
+    inline juce::AudioChannelSet getChannelSet(int numChannels)
+    {
+        switch (numChannels)
+        {
+            case 10:    return juce::AudioChannelSet::create7point1point2();
+            case 12:    return juce::AudioChannelSet::create7point1point4();
+            default:    return juce::AudioChannelSet::canonicalChannelSet(numChannels);
+        }
+    }
+
+    // false if the processor doesn't take that many channels
+    inline bool prepare(HatsOffAudioProcessor& processor, int numChannels, double sampleRate, int blockSize,
+                        bool doublePrecision = false)
+    {
+        // the precision decides which chain prepareToPlay builds
+        processor.setProcessingPrecision(doublePrecision ? juce::AudioProcessor::doublePrecision
+                                                         : juce::AudioProcessor::singlePrecision);
+
+        auto channelSet = getChannelSet(numChannels);
+
+        juce::AudioProcessor::BusesLayout layout;
+        layout.inputBuses.add(channelSet);
+        layout.outputBuses.add(channelSet);
+
+        if (! processor.setBusesLayout(layout))
+            return false;
+
+        processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+        processor.prepareToPlay(sampleRate, blockSize);
+        return true;
+    }
+}
@@ -0,0 +1,613 @@
+/*
+  ==============================================================================
+
+    HatsOffNullTest - renders fixed test signals through HatsOffAudioProcessor
+    and null-tests the results, so a change to the DSP can't alter the sound
+    without somebody noticing.
+
+    The signals are generated here, the same on every machine: a log sine
+    sweep, a row of impulses and a hi-hat loop, in stereo. These checks are
+    run on them:
+
+     - split: with the band compressors out of the way (bypassed, or under
+       their threshold) and the hats at 0% mix, the output has to null
+       against the input run through the two Linkwitz-Riley allpasses that
+       the three bands sum to. Tolerance: splitToleranceDb.
+     - flatness: the magnitude response of that split, from an impulse, has
+       to stay within flatnessToleranceDb of 0 dB from 20 Hz to 20 kHz.
+     - block size: the default settings have to render the same at any block
+       size. Tolerance: blockSizeToleranceDb.
+     - precision: the Fast precision has to render the same as Exact, to
+       precisionToleranceDb.
+     - golden: each signal, at a few settings, has to null against the render
+       stored in the golden directory. Tolerance: goldenToleranceDb.
+
+    One more renders nothing: a session saved by the first version, which had
+    a single compressor over the whole signal, has to load its settings onto
+    all three bands.
+
+    --write-golden renders the golden files instead of checking them; do that
+    on purpose, when the sound is meant to change, and commit the result.
+    --write-missing only writes the ones that don't exist yet and checks the
+    rest, for adding a signal or settings by hand; the new files have to be
+    committed. The build's run never writes any, a missing file fails it.
+
+    Exits with 2 if any check failed, or a golden file is missing and wasn't
+    written.
+
+    HatsOffNullTest [--golden-dir=Tools/NullTest/Golden] [--write-golden | --write-missing]
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+
+#include "PluginProcessor.h"
+#include "ProcessorSetup.h"
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#ifndef HATSOFF_GOLDEN_DIR
+ #define HATSOFF_GOLDEN_DIR "Tools/NullTest/Golden"
+#endif
+
+namespace
+{
+// peak of the residual, in dB against full scale
+constexpr double splitToleranceDb = -90.0;
+constexpr double blockSizeToleranceDb = -110.0;
+constexpr double precisionToleranceDb = -90.0;
+constexpr double goldenToleranceDb = -80.0;
+constexpr double flatnessToleranceDb = 0.01;
+
+constexpr double goldenSampleRate = 44100.0;
+constexpr int goldenBlockSize = 512;
+constexpr int numChannels = 2;
+
+struct NullTestSettings
+{
+    juce::File goldenDirectory;
+    bool writeGolden = false;
+    bool writeMissing = false;
+};
+
+void printUsage()
+{
+    std::cout << "Usage: HatsOffNullTest [--golden-dir=" << HATSOFF_GOLDEN_DIR << "] [--write-golden | --write-missing]" << std::endl;
+}
+
+bool parseSettings(const juce::ArgumentList& args, NullTestSettings& settings)
+{
+    if (args.containsOption("--help|-h"))
+        return false;
+
+    settings.goldenDirectory = args.containsOption("--golden-dir")
+                                 ? args.getFileForOption("--golden-dir")
+                                 : juce::File::getCurrentWorkingDirectory().getChildFile(HATSOFF_GOLDEN_DIR);
+    settings.writeGolden = args.containsOption("--write-golden");
+    settings.writeMissing = args.containsOption("--write-missing");
+    return true;
+}
+
+//==============================================================================
+// plain parameter values on top of the defaults
+struct Settings
+{
+    const char* name;
+    std::vector<std::pair<const char*, float>> parameters;
+};
+
+// the compressors can't touch the signal in either of these, and the hats are off
+const std::vector<Settings> transparentSettings
+{
+    { "bypassed",        { { "Bypassed Low Band", 1.0f }, { "Bypassed Mid Band", 1.0f }, { "Bypassed High Band", 1.0f },
+                           { "Mix", 0.0f } } },
+    { "under threshold", { { "Threshold Low Band", 12.0f }, { "Threshold Mid Band", 12.0f }, { "Threshold High Band", 12.0f },
+                           { "Mix", 0.0f } } },
+};
+
+const std::vector<Settings> goldenSettings
+{
+    { "default",  {} },
+    { "heavy",    { { "Lookahead", 5.0f }, { "Oversampling", 1.0f }, { "Link Mode", 1.0f },
+                    { "Threshold Low Band", -30.0f }, { "Threshold Mid Band", -30.0f },
+                    { "Threshold High Band", -30.0f }, { "Mix", 100.0f } } },
+    { "mid-side", { { "Link Mode", 3.0f }, { "Threshold High Band", -24.0f } } },
+};
+
+//==============================================================================
+/*
+ The signals have to come out bit for bit the same on every platform, so the
+ noise is a plain xorshift instead of <random>, whose distributions aren't
+ specified exactly.
+ */
+class Noise
+{
+public:
+    float next() noexcept
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (float) state / 2147483648.0f - 1.0f;
+    }
+
+private:
+    uint32_t state = 2463534242u;
+};
+
+using Signal = juce::AudioBuffer<float>;
+
+Signal makeSweep(double sampleRate)
+{
+    const auto length = juce::roundToInt(2.0 * sampleRate);
+    const auto startHz = 20.0, endHz = juce::jmin(20000.0, 0.45 * sampleRate);
+    const auto rate = std::log(endHz / startHz);
+    Signal signal(numChannels, length);
+
+    for (auto i = 0; i < length; ++i)
+    {
+        const auto t = (double) i / (double) length;
+        const auto phase = juce::MathConstants<double>::twoPi * startHz * (double) length / sampleRate
+                         * (std::exp(rate * t) - 1.0) / rate;
+
+        for (auto channel = 0; channel < numChannels; ++channel)
+            signal.setSample(channel, i, (float) (0.5 * std::sin(phase)));
+    }
+
+    return signal;
+}
+
+Signal makeImpulses(double sampleRate)
+{
+    const auto spacing = juce::roundToInt(0.25 * sampleRate);
+    Signal signal(numChannels, 4 * spacing);
+    signal.clear();
+
+    // one sample apart on the two sides, so anything linked or mid/side shows
+    for (auto i = 0; i < 4; ++i)
+    {
+        signal.setSample(0, i * spacing, 0.9f);
+        signal.setSample(1, i * spacing + 1, 0.9f);
+    }
+
+    return signal;
+}
+
+// a bar of 120 bpm: closed hats on the eighths, an open one before the
+// last beat, a kick on one and three
+Signal makeHats(double sampleRate)
+{
+    const auto eighth = juce::roundToInt(0.25 * sampleRate);
+    Signal signal(numChannels, 8 * eighth);
+    signal.clear();
+    Noise noise;
+
+    auto addHit = [&](int start, double decaySeconds, float level, float pan)
+    {
+        auto previous = 0.0f;
+
+        for (auto i = start; i < signal.getNumSamples(); ++i)
+        {
+            // a first difference tilts the noise up, towards something hat-like
+            const auto white = noise.next();
+            const auto bright = white - previous;
+            previous = white;
+
+            const auto envelope = level * (float) std::exp(-(double) (i - start) / (decaySeconds * sampleRate));
+            signal.addSample(0, i, bright * envelope * (1.0f - pan));
+            signal.addSample(1, i, bright * envelope * pan);
+        }
+    };
+
+    auto addKick = [&](int start)
+    {
+        auto phase = 0.0;
+
+        for (auto i = start; i < signal.getNumSamples(); ++i)
+        {
+            const auto t = (double) (i - start) / sampleRate;
+            phase += juce::MathConstants<double>::twoPi * (50.0 + 100.0 * std::exp(-t / 0.02)) / sampleRate;
+            const auto sample = (float) (0.6 * std::sin(phase) * std::exp(-t / 0.15));
+
+            for (auto channel = 0; channel < numChannels; ++channel)
+                signal.addSample(channel, i, sample);
+        }
+    };
+
+    for (auto step = 0; step < 8; ++step)
+        addHit(step * eighth, step == 5 ? 0.2 : 0.03, 0.25f, step % 2 == 0 ? 0.4f : 0.6f);
+
+    addKick(0);
+    addKick(4 * eighth);
+    return signal;
+}
+
+struct TestSignal
+{
+    const char* name;
+    Signal (*make)(double sampleRate);
+};
+
+const TestSignal testSignals[] { { "sweep", makeSweep }, { "impulses", makeImpulses }, { "hats", makeHats } };
+
+//==============================================================================
+// the output lined up with the input: rendered with the latency's worth of silence on the end, then trimmed
+Signal render(const Settings& settings, const Signal& input, double sampleRate, int blockSize)
+{
+    HatsOffAudioProcessor processor;
+
+    for (auto& [id, value] : settings.parameters)
+        ProcessorSetup::setParameter(processor, id, value);
+
+    ProcessorSetup::prepare(processor, numChannels, sampleRate, blockSize);
+
+    const auto latency = processor.getLatencySamples();
+    const auto length = input.getNumSamples();
+
+    Signal output(numChannels, length + latency);
+    output.clear();
+
+    for (auto channel = 0; channel < numChannels; ++channel)
+        output.copyFrom(channel, 0, input, channel, 0, length);
+
+    juce::MidiBuffer midi;
+
+    for (auto start = 0; start < output.getNumSamples(); start += blockSize)
+    {
+        const auto numSamples = juce::jmin(blockSize, output.getNumSamples() - start);
+        juce::AudioBuffer<float> block(output.getArrayOfWritePointers(), numChannels, start, numSamples);
+        processor.processBlock(block, midi);
+    }
+
+    processor.releaseResources();
+
+    Signal aligned(numChannels, length);
+
+    for (auto channel = 0; channel < numChannels; ++channel)
+        aligned.copyFrom(channel, 0, output, channel, latency, length);
+
+    return aligned;
+}
+
+// what the three bands add up to with nothing else going on: both crossovers' allpasses
+Signal makeSplitReference(const Signal& input, double sampleRate)
+{
+    HatsOffAudioProcessor defaults;
+    Signal reference(input);
+
+    for (auto* id : { "Low-Mid Crossover Freq", "Mid-High Crossover Freq" })
+    {
+        auto* parameter = defaults.apvts.getParameter(id);
+        juce::dsp::LinkwitzRileyFilter<double> allpass;
+        allpass.setType(juce::dsp::LinkwitzRileyFilterType::allpass);
+        allpass.setCutoffFrequency(parameter->convertFrom0to1(parameter->getValue()));
+        allpass.prepare({ sampleRate, (juce::uint32) input.getNumSamples(), (juce::uint32) numChannels });
+
+        for (auto channel = 0; channel < numChannels; ++channel)
+        {
+            auto* data = reference.getWritePointer(channel);
+
+            for (auto i = 0; i < reference.getNumSamples(); ++i)
+                data[i] = (float) allpass.processSample(channel, (double) data[i]);
+        }
+    }
+
+    return reference;
+}
+
+struct Residual
+{
+    double peakDb = -300.0;
+    int channel = 0, index = 0;
+};
+
+Residual measureResidual(const Signal& a, const Signal& b)
+{
+    Residual residual;
+    auto peak = 0.0;
+
+    for (auto channel = 0; channel < numChannels; ++channel)
+    {
+        for (auto i = 0; i < juce::jmin(a.getNumSamples(), b.getNumSamples()); ++i)
+        {
+            const auto difference = std::abs((double) a.getSample(channel, i) - (double) b.getSample(channel, i));
+
+            // a NaN counts as the worst possible difference
+            if (! (difference <= peak))
+            {
+                peak = std::isnan(difference) ? 1.0e10 : difference;
+                residual.channel = channel;
+                residual.index = i;
+            }
+        }
+    }
+
+    residual.peakDb = juce::Decibels::gainToDecibels(peak, -300.0);
+
+    if (a.getNumSamples() != b.getNumSamples())
+        residual.peakDb = 300.0;
+
+    return residual;
+}
+
+//==============================================================================
+class Checks
+{
+public:
+    void report(const juce::String& name, bool passed, const juce::String& detail)
+    {
+        std::cout << (passed ? "PASS  " : "FAIL  ") << std::left << std::setw(44) << name << detail << std::endl;
+
+        if (! passed)
+            ++numFailed;
+
+        ++numRun;
+    }
+
+    void reportResidual(const juce::String& name, const Residual& residual, double toleranceDb)
+    {
+        report(name, residual.peakDb <= toleranceDb,
+               juce::String(residual.peakDb, 1) + " dB (limit " + juce::String(toleranceDb, 1) + " dB)"
+               + (residual.peakDb > toleranceDb ? ", worst at channel " + juce::String(residual.channel)
+                                                  + " sample " + juce::String(residual.index)
+                                                : juce::String()));
+    }
+
+    int numRun = 0, numFailed = 0;
+};
+
+void checkSplit(Checks& checks)
+{
+    for (auto sampleRate : { 44100.0, 48000.0, 96000.0 })
+    {
+        for (auto& signal : testSignals)
+        {
+            const auto input = signal.make(sampleRate);
+            const auto reference = makeSplitReference(input, sampleRate);
+
+            for (auto& settings : transparentSettings)
+                checks.reportResidual(juce::String("split ") + settings.name + ", " + signal.name + ", "
+                                          + juce::String(sampleRate / 1000.0, 1) + " kHz",
+                                      measureResidual(render(settings, input, sampleRate, 512), reference),
+                                      splitToleranceDb);
+        }
+    }
+}
+
+// the magnitude of the bands' sum, from one impulse, over the audible range
+void checkFlatness(Checks& checks)
+{
+    constexpr auto order = 16;
+    constexpr auto size = 1 << order;
+    constexpr auto sampleRate = 48000.0;
+
+    Signal impulse(numChannels, size);
+    impulse.clear();
+    impulse.setSample(0, 0, 1.0f);
+    impulse.setSample(1, 0, 1.0f);
+
+    for (auto& settings : transparentSettings)
+    {
+        const auto response = render(settings, impulse, sampleRate, 512);
+
+        std::vector<float> spectrum(2 * size, 0.0f);
+        std::copy(response.getReadPointer(0), response.getReadPointer(0) + size, spectrum.begin());
+
+        juce::dsp::FFT fft(order);
+        fft.performFrequencyOnlyForwardTransform(spectrum.data());
+
+        auto worstDb = 0.0, worstHz = 0.0;
+
+        for (auto bin = 1; bin < size / 2; ++bin)
+        {
+            const auto hz = bin * sampleRate / size;
+
+            if (hz < 20.0 || hz > 20000.0)
+                continue;
+
+            const auto db = juce::Decibels::gainToDecibels((double) spectrum[(size_t) bin], -300.0);
+
+            if (std::abs(db) > std::abs(worstDb))
+            {
+                worstDb = db;
+                worstHz = hz;
+            }
+        }
+
+        checks.report(juce::String("flatness ") + settings.name,
+                      std::abs(worstDb) <= flatnessToleranceDb,
+                      juce::String(worstDb, 4) + " dB at " + juce::String(worstHz, 0) + " Hz (limit +-"
+                          + juce::String(flatnessToleranceDb, 2) + " dB)");
+    }
+}
+
+void checkBlockSizes(Checks& checks)
+{
+    const auto input = makeHats(goldenSampleRate);
+    const auto reference = render(goldenSettings[0], input, goldenSampleRate, goldenBlockSize);
+
+    for (auto blockSize : { 1, 37, 64, 1000, 4096 })
+        checks.reportResidual("block size " + juce::String(blockSize) + " against " + juce::String(goldenBlockSize),
+                              measureResidual(render(goldenSettings[0], input, goldenSampleRate, blockSize), reference),
+                              blockSizeToleranceDb);
+}
+
+// FastMath's error, through every detector at once
+void checkPrecision(Checks& checks)
+{
+    for (auto settings : goldenSettings)
+    {
+        const auto input = makeHats(goldenSampleRate);
+        const auto exact = render(settings, input, goldenSampleRate, goldenBlockSize);
+
+        settings.parameters.push_back({ "Precision", 1.0f });
+        checks.reportResidual(juce::String("precision fast against exact, ") + settings.name,
+                              measureResidual(render(settings, input, goldenSampleRate, goldenBlockSize), exact),
+                              precisionToleranceDb);
+    }
+}
+
+// the state the first version saved: the APVTS tree, with one compressor's parameters
+void checkLegacyState(Checks& checks)
+{
+    const std::vector<std::pair<const char*, float>> legacyParameters
+    {
+        { "Threshold", -24.0f }, { "Attack", 10.0f }, { "Release", 120.0f }, { "Ratio", 5.0f }, { "Bypassed", 1.0f }
+    };
+
+    const std::vector<std::pair<const char*, float>> sharedParameters
+    {
+        { "Gain", -6.0f }, { "Pause", 0.0f }, { "Mix", 30.0f }, { "Freq", 1000.0f }
+    };
+
+    juce::ValueTree state ("Parameters");
+
+    for (auto* parameters : { &legacyParameters, &sharedParameters })
+        for (auto& [id, value] : *parameters)
+            state.appendChild(juce::ValueTree("PARAM").setProperty("id", id, nullptr).setProperty("value", value, nullptr), nullptr);
+
+    juce::MemoryBlock data;
+
+    {
+        juce::MemoryOutputStream stream(data, false);
+        state.writeToStream(stream);
+    }
+
+    HatsOffAudioProcessor processor;
+    processor.setStateInformation(data.getData(), (int) data.getSize());
+
+    auto checkValue = [&](const juce::String& id, float expected)
+    {
+        auto* parameter = processor.apvts.getParameter(id);
+        const auto actual = parameter != nullptr ? parameter->convertFrom0to1(parameter->getValue()) : std::nanf("");
+
+        checks.report("legacy state, " + id, std::abs(actual - expected) < 1.0e-3f,
+                      "expected " + juce::String(expected) + ", got " + juce::String(actual));
+    };
+
+    for (auto& [id, value] : legacyParameters)
+        for (auto* band : { " Low Band", " Mid Band", " High Band" })
+            checkValue(juce::String(id) + band, value);
+
+    for (auto& [id, value] : sharedParameters)
+        checkValue(id, value);
+}
+
+juce::File getGoldenFile(const NullTestSettings& nullTestSettings, const TestSignal& signal, const Settings& settings)
+{
+    return nullTestSettings.goldenDirectory.getChildFile(juce::String(signal.name) + "-" + juce::String(settings.name) + ".wav");
+}
+
+bool writeGolden(const juce::File& file, const Signal& output)
+{
+    file.deleteFile();
+    auto stream = file.createOutputStream();
+    juce::WavAudioFormat wav;
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+
+    // 32 bit is float in a WAV, so the file holds exactly what was rendered
+    if (stream != nullptr)
+        writer.reset(wav.createWriterFor(stream.get(), goldenSampleRate, (unsigned int) numChannels, 32, {}, 0));
+
+    if (writer == nullptr)
+        return false;
+
+    stream.release(); // the writer owns the stream now
+    return writer->writeFromAudioSampleBuffer(output, 0, output.getNumSamples());
+}
+
+bool readGolden(const juce::File& file, Signal& golden)
+{
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+
+    std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(file));
+
+    if (reader == nullptr || (int) reader->numChannels != numChannels)
+        return false;
+
+    golden.setSize(numChannels, (int) reader->lengthInSamples);
+    return reader->read(&golden, 0, golden.getNumSamples(), 0, true, true);
+}
+
+void checkGolden(Checks& checks, const NullTestSettings& nullTestSettings)
+{
+    if (nullTestSettings.writeGolden || nullTestSettings.writeMissing)
+        nullTestSettings.goldenDirectory.createDirectory();
+
+    for (auto& signal : testSignals)
+    {
+        const auto input = signal.make(goldenSampleRate);
+
+        for (auto& settings : goldenSettings)
+        {
+            const auto name = juce::String("golden ") + signal.name + ", " + settings.name;
+            const auto file = getGoldenFile(nullTestSettings, signal, settings);
+            const auto output = render(settings, input, goldenSampleRate, goldenBlockSize);
+
+            if (nullTestSettings.writeGolden)
+            {
+                const auto written = writeGolden(file, output);
+                checks.report(name, written, (written ? "wrote " : "could not write ") + file.getFullPathName());
+                continue;
+            }
+
+            Signal golden;
+
+            if (! readGolden(file, golden))
+            {
+                if (! nullTestSettings.writeMissing)
+                {
+                    checks.report(name, false, "no golden file at " + file.getFullPathName() + ", run with --write-golden");
+                    continue;
+                }
+
+                // nothing to compare with yet; this render becomes the reference
+                const auto written = writeGolden(file, output);
+                checks.report(name, written, (written ? "new, wrote " : "no golden file, could not write ")
+                                                 + file.getFullPathName() + (written ? ", commit it" : ""));
+                continue;
+            }
+
+            checks.reportResidual(name, measureResidual(output, golden), goldenToleranceDb);
+        }
+    }
+}
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::ArgumentList args(argc, argv);
+    NullTestSettings settings;
+
+    if (! parseSettings(args, settings))
+    {
+        printUsage();
+        return 1;
+    }
+
+    Checks checks;
+
+    // the golden files are only written from the same renders the checks use
+    if (! settings.writeGolden)
+    {
+        checkSplit(checks);
+        checkFlatness(checks);
+        checkBlockSizes(checks);
+        checkPrecision(checks);
+        checkLegacyState(checks);
+    }
+
+    checkGolden(checks, settings);
+
+    std::cout << std::endl << checks.numRun - checks.numFailed << " of " << checks.numRun << " passed" << std::endl;
+    return checks.numFailed > 0 ? 2 : 0;
+}
@@ -0,0 +1,367 @@
+/*
+  ==============================================================================
+
+    HatsOffRenderer - headless offline renderer and real-time-factor benchmark.
+
+    Streams a WAV file through HatsOffAudioProcessor at a fixed block size and
+    reports how much faster than real time the processor runs, the per-block
+    timing distribution and how many instances a single core could sustain.
+    When built with HATSOFF_REALTIME_CHECKS it also fails (exit code 2) if any
+    processBlock call allocated, freed or locked a mutex.
+
+    --oversampling takes a comma separated list of factors and prints one
+    report per factor, so the cost of each can be compared on the same input.
+    --double runs the processor's double precision processBlock instead.
+
+    --sparse=0.1 keeps only that fraction of every 10 seconds of the input and
+    silences the rest, like a track in a big template that rarely plays.
+    --compare-idle renders each configuration with idle detection off and then
+    on, and prints how much CPU skipping the silent blocks saved.
+
+    HatsOffRenderer <input.wav> [--output=out.wav] [--block-size=512]
+                    [--sample-rate=48000] [--channels=2] [--passes=1]
+                    [--oversampling=1,2,4,8] [--oversampling-filter=iir|linear]
+                    [--double] [--sparse=0.1] [--compare-idle]
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+
+#include "PluginProcessor.h"
+#include "BlockTimingStats.h"
+#include "ProcessorSetup.h"
+
+#include <iostream>
+
+namespace
+{
+struct RenderSettings
+{
+    juce::File input;
+    juce::File output;
+    int blockSize = 512;
+    double sampleRate = 0.0;    // 0 = use the file's rate
+    int numChannels = 0;        // 0 = use the file's channel count
+    int passes = 1;
+    juce::Array<int> oversamplingFactors { 1 };
+    int oversamplingFilter = 0; // index of the "Oversampling Filter" choice
+    bool doublePrecision = false;
+    double activeFraction = 1.0;    // < 1 silences the rest of every sparse cycle
+    bool compareIdle = false;
+};
+
+constexpr double sparseCycleSeconds = 10.0;
+
+void printUsage()
+{
+    std::cout << "Usage: HatsOffRenderer <input.wav> [--output=out.wav] [--block-size=512]" << std::endl
+              << "                       [--sample-rate=48000] [--channels=2] [--passes=1]" << std::endl
+              << "                       [--oversampling=1,2,4,8] [--oversampling-filter=iir|linear]" << std::endl
+              << "                       [--double] [--sparse=0.1] [--compare-idle]" << std::endl;
+}
+
+int getIntOption(const juce::ArgumentList& args, const juce::String& option, int defaultValue)
+{
+    return args.containsOption(option) ? args.getValueForOption(option).getIntValue() : defaultValue;
+}
+
+bool parseSettings(const juce::ArgumentList& args, RenderSettings& settings)
+{
+    if (args.size() == 0 || args.containsOption("--help|-h"))
+        return false;
+
+    settings.input = args[0].resolveAsFile();
+
+    if (! settings.input.existsAsFile())
+        return false;
+
+    if (args.containsOption("--output"))
+        settings.output = args.getFileForOption("--output");
+
+    settings.blockSize = getIntOption(args, "--block-size", settings.blockSize);
+    settings.numChannels = getIntOption(args, "--channels", settings.numChannels);
+    settings.passes = getIntOption(args, "--passes", settings.passes);
+
+    settings.doublePrecision = args.containsOption("--double");
+    settings.compareIdle = args.containsOption("--compare-idle");
+
+    if (args.containsOption("--sparse"))
+        settings.activeFraction = args.getValueForOption("--sparse").getDoubleValue();
+
+    if (args.containsOption("--sample-rate"))
+        settings.sampleRate = args.getValueForOption("--sample-rate").getDoubleValue();
+
+    if (args.containsOption("--oversampling"))
+    {
+        settings.oversamplingFactors.clear();
+
+        for (auto& factor : juce::StringArray::fromTokens(args.getValueForOption("--oversampling"), ",", {}))
+        {
+            auto value = factor.trim().getIntValue();
+
+            if (value != 1 && value != 2 && value != 4 && value != 8)
+                return false;
+
+            settings.oversamplingFactors.add(value);
+        }
+    }
+
+    if (args.containsOption("--oversampling-filter"))
+    {
+        auto filter = args.getValueForOption("--oversampling-filter").toLowerCase();
+
+        if (filter != "iir" && filter != "linear")
+            return false;
+
+        settings.oversamplingFilter = filter == "iir" ? 0 : 1;
+    }
+
+    return settings.blockSize > 0 && settings.passes > 0 && settings.numChannels >= 0
+        && settings.activeFraction >= 0.0 && settings.activeFraction <= 1.0
+        && ! settings.oversamplingFactors.isEmpty();
+}
+
+std::unique_ptr<juce::AudioFormatReader> createReader(juce::AudioFormatManager& formats, const juce::File& file)
+{
+    return std::unique_ptr<juce::AudioFormatReader>(formats.createReaderFor(file));
+}
+
+bool configureProcessor(HatsOffAudioProcessor& processor, int numChannels, double sampleRate, int blockSize,
+                        int oversamplingFactor, int oversamplingFilter, bool doublePrecision)
+{
+    // set before prepareToPlay so the reported latency is already the right one
+    ProcessorSetup::setParameter(processor, "Oversampling", (float) juce::roundToInt(std::log2(oversamplingFactor)));
+    ProcessorSetup::setParameter(processor, "Oversampling Filter", (float) oversamplingFilter);
+
+    return ProcessorSetup::prepare(processor, numChannels, sampleRate, blockSize, doublePrecision);
+}
+
+// silences everything after the first activeFraction of each cycle
+void makeSparse(juce::AudioBuffer<float>& source, double sampleRate, double activeFraction)
+{
+    const auto cycleLength = juce::jmax(1, juce::roundToInt(sparseCycleSeconds * sampleRate));
+    const auto activeLength = juce::roundToInt(activeFraction * cycleLength);
+
+    for (auto cycleStart = 0; cycleStart < source.getNumSamples(); cycleStart += cycleLength)
+    {
+        const auto silenceStart = cycleStart + activeLength;
+        const auto silenceEnd = juce::jmin(cycleStart + cycleLength, source.getNumSamples());
+
+        if (silenceStart < silenceEnd)
+            source.clear(silenceStart, silenceEnd - silenceStart);
+    }
+}
+
+struct RunResult
+{
+    BlockTimingStats stats;
+    int numIdleBlocks = 0;
+};
+
+void printReport(const RenderSettings& settings, const RunResult& result, const HatsOffAudioProcessor& processor,
+                 int numChannels, double sampleRate, int numSourceSamples, int oversamplingFactor, bool idleDetection)
+{
+    const auto& stats = result.stats;
+    auto audioSeconds = (double) numSourceSamples * settings.passes / sampleRate;
+    auto cpuSeconds = stats.getTotal();
+    auto realTimeFactor = cpuSeconds > 0.0 ? audioSeconds / cpuSeconds : 0.0;
+    auto blockDeadline = settings.blockSize / sampleRate;
+    auto p99 = stats.getPercentile(99.0);
+
+    constexpr auto toMicros = 1.0e6;
+
+    std::cout << "input            " << settings.input.getFileName() << std::endl
+              << "channels         " << numChannels << std::endl
+              << "sample rate      " << sampleRate << " Hz" << std::endl
+              << "block size       " << settings.blockSize << std::endl
+              << "precision        " << (settings.doublePrecision ? "double" : "float") << std::endl
+              << "oversampling     " << oversamplingFactor << "x"
+              << (oversamplingFactor > 1 ? (settings.oversamplingFilter == 0 ? " (IIR)" : " (linear phase)") : "") << std::endl
+              << "latency          " << processor.getLatencySamples() << " samples" << std::endl
+              << "idle detection   " << (idleDetection ? "on" : "off") << std::endl
+              << "blocks           " << stats.getNumBlocks() << std::endl
+              << "idle blocks      " << result.numIdleBlocks
+              << " (" << (stats.getNumBlocks() > 0 ? 100.0 * result.numIdleBlocks / (double) stats.getNumBlocks() : 0.0) << "%)" << std::endl
+              << "audio time       " << audioSeconds << " s" << std::endl
+              << "cpu time         " << cpuSeconds << " s" << std::endl
+              << "real-time factor " << realTimeFactor << "x" << std::endl
+              << "block min        " << stats.getMin() * toMicros << " us" << std::endl
+              << "block mean       " << stats.getMean() * toMicros << " us" << std::endl
+              << "block p99        " << p99 * toMicros << " us" << std::endl
+              << "block max        " << stats.getMax() * toMicros << " us" << std::endl
+              << "block deadline   " << blockDeadline * toMicros << " us" << std::endl
+              // Sustained throughput, and the count that still meets the deadline on a p99 block.
+              << "instances/core   " << (int) realTimeFactor
+              << " (p99-safe " << (p99 > 0.0 ? (int) (blockDeadline / p99) : 0) << ")" << std::endl;
+}
+
+std::unique_ptr<juce::AudioFormatWriter> createWriter(const juce::File& file, double sampleRate, int numChannels)
+{
+    file.deleteFile();
+    auto stream = file.createOutputStream();
+    juce::WavAudioFormat wav;
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+
+    if (stream != nullptr)
+        writer.reset(wav.createWriterFor(stream.get(), sampleRate, (unsigned int) numChannels, 24, {}, 0));
+
+    if (writer != nullptr)
+        stream.release(); // the writer owns the stream now
+
+    return writer;
+}
+
+// every pass of the source through the processor, one timed processBlock per block
+RunResult run(const RenderSettings& settings, HatsOffAudioProcessor& processor, const juce::AudioBuffer<float>& source,
+              int numChannels, juce::AudioFormatWriter* writer)
+{
+    const auto numFileChannels = source.getNumChannels();
+    const auto numSourceSamples = source.getNumSamples();
+
+    juce::AudioBuffer<float> block(numChannels, settings.blockSize);
+    juce::AudioBuffer<double> doubleBlock(settings.doublePrecision ? numChannels : 0, settings.blockSize);
+    juce::MidiBuffer midi;
+    RunResult result;
+    result.stats.reserve((size_t) (settings.passes * (numSourceSamples / settings.blockSize + 1)));
+
+    for (auto pass = 0; pass < settings.passes; ++pass)
+    {
+        for (auto start = 0; start < numSourceSamples; start += settings.blockSize)
+        {
+            auto numSamples = juce::jmin(settings.blockSize, numSourceSamples - start);
+            block.setSize(numChannels, numSamples, false, false, true);
+
+            for (auto channel = 0; channel < numChannels; ++channel)
+                block.copyFrom(channel, 0, source, channel % numFileChannels, start, numSamples);
+
+            // the conversions stay outside the timed region
+            if (settings.doublePrecision)
+                doubleBlock.makeCopyOf(block, true);
+
+            auto begin = BlockTimingStats::Clock::now();
+
+            if (settings.doublePrecision)
+                processor.processBlock(doubleBlock, midi);
+            else
+                processor.processBlock(block, midi);
+
+            auto end = BlockTimingStats::Clock::now();
+
+            result.stats.add(BlockTimingStats::secondsBetween(begin, end));
+
+            if (processor.isIdle())
+                ++result.numIdleBlocks;
+
+            if (settings.doublePrecision)
+                block.makeCopyOf(doubleBlock, true);
+
+            if (writer != nullptr && pass == 0)
+                writer->writeFromAudioSampleBuffer(block, 0, numSamples);
+        }
+    }
+
+    return result;
+}
+
+int render(const RenderSettings& settings)
+{
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+
+    auto reader = createReader(formats, settings.input);
+    if (reader == nullptr)
+    {
+        std::cerr << "Could not open " << settings.input.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    auto numFileChannels = (int) reader->numChannels;
+    auto numSourceSamples = (int) reader->lengthInSamples;
+    auto numChannels = settings.numChannels > 0 ? settings.numChannels : numFileChannels;
+    auto sampleRate = settings.sampleRate > 0.0 ? settings.sampleRate : reader->sampleRate;
+
+    // The file is processed as if it were recorded at the requested rate; we
+    // measure throughput, so no resampling is done.
+    juce::AudioBuffer<float> source(numFileChannels, numSourceSamples);
+    reader->read(&source, 0, numSourceSamples, 0, true, true);
+
+    if (settings.activeFraction < 1.0)
+        makeSparse(source, sampleRate, settings.activeFraction);
+
+    const auto idleModes = settings.compareIdle ? juce::Array<bool> { false, true } : juce::Array<bool> { true };
+    auto numReports = 0;
+
+    for (auto index = 0; index < settings.oversamplingFactors.size(); ++index)
+    {
+        auto oversamplingFactor = settings.oversamplingFactors[index];
+        auto cpuWithoutIdle = 0.0;
+
+        for (auto idleDetection : idleModes)
+        {
+            HatsOffAudioProcessor processor;
+            processor.setIdleDetectionEnabled(idleDetection);
+
+            if (! configureProcessor(processor, numChannels, sampleRate, settings.blockSize,
+                                     oversamplingFactor, settings.oversamplingFilter, settings.doublePrecision))
+            {
+                std::cerr << "HatsOff does not support " << numChannels << " channels" << std::endl;
+                return 1;
+            }
+
+            // only the first configuration of a sweep is written out
+            std::unique_ptr<juce::AudioFormatWriter> writer;
+            if (settings.output != juce::File() && numReports == 0)
+            {
+                writer = createWriter(settings.output, sampleRate, numChannels);
+
+                if (writer == nullptr)
+                {
+                    std::cerr << "Could not write " << settings.output.getFullPathName() << std::endl;
+                    return 1;
+                }
+            }
+
+            auto result = run(settings, processor, source, numChannels, writer.get());
+
+            processor.releaseResources();
+
+            if (RealtimeGuard::isEnabled() && RealtimeGuard::getNumViolations() > 0)
+            {
+                std::cerr << "processBlock is not real-time safe: " << RealtimeGuard::getNumViolations()
+                          << " violation(s), last was " << RealtimeGuard::getLastViolation() << std::endl;
+                return 2;
+            }
+
+            if (numReports++ > 0)
+                std::cout << std::endl;
+
+            printReport(settings, result, processor, numChannels, sampleRate, numSourceSamples, oversamplingFactor, idleDetection);
+
+            if (! idleDetection)
+                cpuWithoutIdle = result.stats.getTotal();
+            else if (settings.compareIdle && cpuWithoutIdle > 0.0)
+                std::cout << "idle cpu saved    " << 100.0 * (1.0 - result.stats.getTotal() / cpuWithoutIdle) << "%" << std::endl;
+        }
+    }
+
+    return 0;
+}
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::ArgumentList args(argc, argv);
+    RenderSettings settings;
+
+    if (! parseSettings(args, settings))
+    {
+        printUsage();
+        return 1;
+    }
+
+    return render(settings);
+}
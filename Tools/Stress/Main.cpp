@@ -0,0 +1,497 @@
+/*
+  ==============================================================================
+
+    HatsOffStress - drives HatsOffAudioProcessor the way a badly behaved host
+    and a badly behaved session would, and reports the worst blocks.
+
+    The stream is cut into segments of a few seconds. Every segment prepares
+    the processor again at a random sample rate, channel count and maximum
+    block size. Within a segment, every block:
+     - has a random length, now and then longer than the prepared maximum;
+     - carries one of several kinds of input: noise, sine, bursts, silence,
+       values in the denormal range, or hot values far over full scale;
+       single NaN and infinite samples are dropped in at random;
+     - may come with automation of random parameters, a program change, a
+       saved state or an earlier state restored between blocks.
+
+    Only processBlock is timed. The report gives:
+     - the per-block time distribution;
+     - a histogram of each block's time as a fraction of its own duration;
+     - every block over --deadline (that fraction of its duration), with what
+       happened in it;
+     - every block whose output wasn't finite.
+    The seed is printed so a failure can be run again.
+
+    Exits with 2 if any output was not finite (or, with
+    HATSOFF_REALTIME_CHECKS, if processBlock allocated or locked), and with
+    3 if any block missed its deadline.
+
+    HatsOffStress [--seconds=60] [--seed=1] [--max-block-size=4096]
+                  [--sample-rates=44100,48000,88200,96000,192000]
+                  [--channels=1,2,6,8,12] [--deadline=1.0] [--double]
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+
+#include "PluginProcessor.h"
+#include "BlockTimingStats.h"
+#include "ProcessorSetup.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace
+{
+struct StressSettings
+{
+    double seconds = 60.0;
+    uint32_t seed = 1;
+    int maxBlockSize = 4096;
+    juce::Array<double> sampleRates { 44100.0, 48000.0, 88200.0, 96000.0, 192000.0 };
+    juce::Array<int> channelCounts { 1, 2, 6, 8, 12 };
+    double deadline = 1.0;      // of the block's own duration
+    bool doublePrecision = false;
+};
+
+constexpr int maxReports = 20;  // per kind, the counts are always complete
+
+void printUsage()
+{
+    std::cout << "Usage: HatsOffStress [--seconds=60] [--seed=1] [--max-block-size=4096]" << std::endl
+              << "                     [--sample-rates=44100,48000,88200,96000,192000]" << std::endl
+              << "                     [--channels=1,2,6,8,12] [--deadline=1.0] [--double]" << std::endl;
+}
+
+template <typename ValueType>
+bool parseList(const juce::ArgumentList& args, const juce::String& option, juce::Array<ValueType>& values)
+{
+    if (! args.containsOption(option))
+        return true;
+
+    values.clear();
+
+    for (auto& token : juce::StringArray::fromTokens(args.getValueForOption(option), ",", {}))
+    {
+        const auto value = (ValueType) token.trim().getDoubleValue();
+
+        if (value <= ValueType(0))
+            return false;
+
+        values.add(value);
+    }
+
+    return ! values.isEmpty();
+}
+
+bool parseSettings(const juce::ArgumentList& args, StressSettings& settings)
+{
+    if (args.containsOption("--help|-h"))
+        return false;
+
+    if (args.containsOption("--seconds"))
+        settings.seconds = args.getValueForOption("--seconds").getDoubleValue();
+
+    if (args.containsOption("--seed"))
+        settings.seed = (uint32_t) args.getValueForOption("--seed").getLargeIntValue();
+
+    if (args.containsOption("--max-block-size"))
+        settings.maxBlockSize = args.getValueForOption("--max-block-size").getIntValue();
+
+    if (args.containsOption("--deadline"))
+        settings.deadline = args.getValueForOption("--deadline").getDoubleValue();
+
+    settings.doublePrecision = args.containsOption("--double");
+
+    return parseList(args, "--sample-rates", settings.sampleRates)
+        && parseList(args, "--channels", settings.channelCounts)
+        && settings.seconds > 0.0 && settings.maxBlockSize > 0 && settings.deadline > 0.0;
+}
+
+//==============================================================================
+// what happened in a block besides the audio, for the reports
+enum BlockEvents : uint32_t
+{
+    prepared        = 1 << 0,
+    automation      = 1 << 1,
+    programChange   = 1 << 2,
+    stateSaved      = 1 << 3,
+    stateRestored   = 1 << 4,
+    nonFiniteInput  = 1 << 5,
+    denormalInput   = 1 << 6,
+    hotInput        = 1 << 7,
+    oversizedBlock  = 1 << 8,
+};
+
+juce::String describeEvents(uint32_t events)
+{
+    static const std::pair<uint32_t, const char*> names[]
+    {
+        { prepared, "prepared" }, { automation, "automation" }, { programChange, "program change" },
+        { stateSaved, "state saved" }, { stateRestored, "state restored" }, { nonFiniteInput, "NaN/Inf input" },
+        { denormalInput, "denormal input" }, { hotInput, "hot input" }, { oversizedBlock, "oversized block" },
+    };
+
+    juce::StringArray list;
+
+    for (auto& [event, name] : names)
+        if ((events & event) != 0)
+            list.add(name);
+
+    return list.isEmpty() ? juce::String() : " [" + list.joinIntoString(", ") + "]";
+}
+
+struct BlockReport
+{
+    int64_t index;
+    double sampleRate;
+    int numSamples, numChannels;
+    double seconds;
+    uint32_t events;
+};
+
+struct StressResult
+{
+    BlockTimingStats stats;
+    std::array<int64_t, 8> loadCounts {};   // see loadBounds
+    int64_t numBlocks = 0;
+    int numSegments = 0;
+    int64_t numOverruns = 0, numNonFinite = 0;
+    std::vector<BlockReport> overruns, nonFinite;
+};
+
+// upper bounds of the load histogram, in percent of the block's duration
+constexpr std::array<double, 7> loadBounds { 1.0, 2.0, 5.0, 10.0, 20.0, 50.0, 100.0 };
+
+//==============================================================================
+/*
+ The test signal. Each kind lasts somewhere between 50 ms and a second, so the
+ detectors get to attack, release and go idle on every one of them.
+ */
+template <typename SampleType>
+class InputGenerator
+{
+public:
+    explicit InputGenerator(std::mt19937& r)  : random(r) {}
+
+    void fill(juce::AudioBuffer<SampleType>& buffer, double sampleRate, uint32_t& events)
+    {
+        const auto numSamples = buffer.getNumSamples();
+
+        for (auto start = 0; start < numSamples;)
+        {
+            if (remaining <= 0)
+                startKind(sampleRate);
+
+            const auto length = juce::jmin(remaining, numSamples - start);
+
+            for (auto channel = 0; channel < buffer.getNumChannels(); ++channel)
+            {
+                auto* data = buffer.getWritePointer(channel);
+
+                for (auto i = start; i < start + length; ++i)
+                    data[i] = generate(channel, i - start);
+            }
+
+            phase += length;
+            remaining -= length;
+            start += length;
+
+            if (kind == Kind::denormal)
+                events |= denormalInput;
+            else if (kind == Kind::hot)
+                events |= hotInput;
+        }
+
+        // the odd broken sample, anywhere in the block
+        if (uniform(random) < 0.01)
+        {
+            const SampleType poison[] { std::numeric_limits<SampleType>::quiet_NaN(),
+                                        std::numeric_limits<SampleType>::infinity(),
+                                        -std::numeric_limits<SampleType>::infinity() };
+
+            buffer.setSample((int) (random() % (uint32_t) buffer.getNumChannels()),
+                             (int) (random() % (uint32_t) numSamples),
+                             poison[random() % 3]);
+            events |= nonFiniteInput;
+        }
+    }
+
+private:
+    enum class Kind { noise, sine, bursts, silence, denormal, hot, numKinds };
+
+    void startKind(double sampleRate)
+    {
+        kind = (Kind) (random() % (uint32_t) Kind::numKinds);
+        remaining = juce::jmax(1, juce::roundToInt((0.05 + 0.95 * uniform(random)) * sampleRate));
+        phase = 0;
+        increment = juce::MathConstants<double>::twoPi * (20.0 + 20000.0 * uniform(random)) / sampleRate;
+        burstPeriod = juce::jmax((int64_t) 1, (int64_t) ((0.05 + 0.45 * uniform(random)) * sampleRate));
+    }
+
+    SampleType generate(int channel, int offset)
+    {
+        const auto noise = 2.0 * uniform(random) - 1.0;
+
+        switch (kind)
+        {
+            case Kind::noise:       return (SampleType) noise;
+            case Kind::sine:        return (SampleType) (0.9 * std::sin(increment * (double) (phase + offset) + channel));
+            case Kind::bursts:
+            {
+                const auto sinceHit = (double) ((phase + offset) % burstPeriod);
+                return (SampleType) (noise * std::exp(-8.0 * sinceHit / (double) burstPeriod));
+            }
+
+            case Kind::denormal:    return (SampleType) noise * std::numeric_limits<SampleType>::denorm_min() * SampleType(64);
+            case Kind::hot:         return (SampleType) (1000.0 * noise);
+            case Kind::silence:
+            case Kind::numKinds:
+            default:                return SampleType(0);
+        }
+    }
+
+    std::mt19937& random;
+    std::uniform_real_distribution<double> uniform { 0.0, 1.0 };
+    Kind kind = Kind::silence;
+    int remaining = 0;
+    int64_t phase = 0;
+    int64_t burstPeriod = 1;
+    double increment = 0.0;
+};
+
+template <typename SampleType>
+bool isFinite(const juce::AudioBuffer<SampleType>& buffer, int numChannels)
+{
+    for (auto channel = 0; channel < numChannels; ++channel)
+        for (auto i = 0; i < buffer.getNumSamples(); ++i)
+            if (! std::isfinite(buffer.getSample(channel, i)))
+                return false;
+
+    return true;
+}
+
+// between blocks, on the same thread, as hosts that automate from the audio thread do
+void changeParameters(HatsOffAudioProcessor& processor, std::mt19937& random, uint32_t& events)
+{
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    const auto& parameters = processor.getParameters();
+
+    if (uniform(random) < 0.3f)
+    {
+        const auto numChanges = 1 + (int) (random() % 4);
+
+        for (auto i = 0; i < numChanges; ++i)
+            parameters[(int) (random() % (uint32_t) parameters.size())]->setValueNotifyingHost(uniform(random));
+
+        events |= automation;
+    }
+
+    if (uniform(random) < 0.002f && processor.getNumPrograms() > 0)
+    {
+        processor.setCurrentProgram((int) (random() % (uint32_t) processor.getNumPrograms()));
+        events |= programChange;
+    }
+}
+
+// the seconds of audio run, 0 if the processor wouldn't take the channel count
+template <typename SampleType>
+double runSegment(const StressSettings& settings, HatsOffAudioProcessor& processor, std::mt19937& random,
+                juce::MemoryBlock& savedState, StressResult& result)
+{
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    const auto sampleRate = settings.sampleRates[(int) (random() % (uint32_t) settings.sampleRates.size())];
+    const auto numChannels = settings.channelCounts[(int) (random() % (uint32_t) settings.channelCounts.size())];
+    const auto preparedBlockSize = 1 + (int) (random() % (uint32_t) settings.maxBlockSize);
+    const auto segmentSamples = (int64_t) ((1.0 + 9.0 * uniform(random)) * sampleRate);
+
+    processor.releaseResources();
+
+    if (! ProcessorSetup::prepare(processor, numChannels, sampleRate, preparedBlockSize, settings.doublePrecision))
+    {
+        std::cerr << "HatsOff does not support " << numChannels << " channels" << std::endl;
+        return 0.0;
+    }
+
+    ++result.numSegments;
+
+    // some hosts hand over more than they said they would, so there's room for twice that
+    juce::AudioBuffer<SampleType> buffer(numChannels, 2 * preparedBlockSize);
+    juce::MidiBuffer midi;
+    InputGenerator<SampleType> input(random);
+    auto events = (uint32_t) prepared;
+
+    for (int64_t position = 0; position < segmentSamples;)
+    {
+        auto numSamples = 1 + (int) (random() % (uint32_t) preparedBlockSize);
+
+        if (uniform(random) < 0.05)
+            numSamples = preparedBlockSize;
+        else if (uniform(random) < 0.01)
+        {
+            numSamples = preparedBlockSize + 1 + (int) (random() % (uint32_t) preparedBlockSize);
+            events |= oversizedBlock;
+        }
+
+        changeParameters(processor, random, events);
+
+        if (uniform(random) < 0.001)
+        {
+            processor.getStateInformation(savedState);
+            events |= stateSaved;
+        }
+        else if (uniform(random) < 0.001 && savedState.getSize() > 0)
+        {
+            processor.setStateInformation(savedState.getData(), (int) savedState.getSize());
+            events |= stateRestored;
+        }
+
+        buffer.setSize(numChannels, numSamples, false, false, true);
+        input.fill(buffer, sampleRate, events);
+
+        auto begin = BlockTimingStats::Clock::now();
+        processor.processBlock(buffer, midi);
+        auto end = BlockTimingStats::Clock::now();
+
+        const auto seconds = BlockTimingStats::secondsBetween(begin, end);
+        const auto duration = numSamples / sampleRate;
+        const BlockReport report { result.numBlocks, sampleRate, numSamples, numChannels, seconds, events };
+
+        result.stats.add(seconds);
+
+        const auto loadPercent = 100.0 * seconds / duration;
+        const auto bucket = std::lower_bound(loadBounds.begin(), loadBounds.end(), loadPercent) - loadBounds.begin();
+        ++result.loadCounts[(size_t) bucket];
+
+        if (seconds > settings.deadline * duration)
+        {
+            if (result.numOverruns++ < maxReports)
+                result.overruns.push_back(report);
+        }
+
+        if (! isFinite(buffer, numChannels))
+        {
+            if (result.numNonFinite++ < maxReports)
+                result.nonFinite.push_back(report);
+        }
+
+        ++result.numBlocks;
+        position += numSamples;
+        events = 0;
+    }
+
+    return (double) segmentSamples / sampleRate;
+}
+
+void printReports(const char* title, int64_t count, const std::vector<BlockReport>& reports)
+{
+    std::cout << std::endl << title << ": " << count << std::endl;
+
+    for (auto& report : reports)
+        std::cout << "  block " << report.index << ": " << report.numSamples << " samples at " << report.sampleRate
+                  << " Hz, " << report.numChannels << " ch, " << report.seconds * 1.0e6 << " us of "
+                  << report.numSamples / report.sampleRate * 1.0e6 << " us" << describeEvents(report.events) << std::endl;
+
+    if (count > (int64_t) reports.size())
+        std::cout << "  ..." << std::endl;
+}
+
+void printResult(const StressSettings& settings, StressResult& result, double audioSeconds)
+{
+    constexpr auto toMicros = 1.0e6;
+    auto& stats = result.stats;
+
+    std::cout << "seed             " << settings.seed << std::endl
+              << "audio time       " << audioSeconds << " s" << std::endl
+              << "precision        " << (settings.doublePrecision ? "double" : "float") << std::endl
+              << "segments         " << result.numSegments << std::endl
+              << "blocks           " << result.numBlocks << std::endl
+              << "block min        " << stats.getMin() * toMicros << " us" << std::endl
+              << "block median     " << stats.getPercentile(50.0) * toMicros << " us" << std::endl
+              << "block p99        " << stats.getPercentile(99.0) * toMicros << " us" << std::endl
+              << "block p99.9      " << stats.getPercentile(99.9) * toMicros << " us" << std::endl
+              << "block max        " << stats.getMax() * toMicros << " us" << std::endl;
+
+    // the worst blocks are the point, so the tail gets a bar even when it's one block
+    std::cout << std::endl << "time / block duration" << std::endl;
+
+    const auto largest = *std::max_element(result.loadCounts.begin(), result.loadCounts.end());
+
+    for (size_t i = 0; i < result.loadCounts.size(); ++i)
+    {
+        const auto label = i < loadBounds.size() ? "< " + juce::String(loadBounds[i]) + "%"
+                                                 : ">= " + juce::String(loadBounds.back()) + "%";
+        const auto count = result.loadCounts[i];
+        const auto bar = count > 0 ? juce::jmax(1, (int) (50 * count / juce::jmax((int64_t) 1, largest))) : 0;
+
+        std::cout << "  " << std::left << std::setw(8) << label << std::right << std::setw(10) << count << "  "
+                  << juce::String::repeatedString("#", bar) << std::endl;
+    }
+
+    printReports(("blocks over " + juce::String(settings.deadline * 100.0) + "% of their duration").toRawUTF8(),
+                 result.numOverruns, result.overruns);
+    printReports("blocks with non-finite output", result.numNonFinite, result.nonFinite);
+}
+
+template <typename SampleType>
+int stress(const StressSettings& settings)
+{
+    std::mt19937 random(settings.seed);
+    HatsOffAudioProcessor processor;
+    juce::MemoryBlock savedState;
+    StressResult result;
+    double audioSeconds = 0.0;
+
+    // whole segments, so the last one may run a little over
+    while (audioSeconds < settings.seconds)
+    {
+        const auto seconds = runSegment<SampleType>(settings, processor, random, savedState, result);
+
+        if (seconds <= 0.0)
+            return 1;
+
+        audioSeconds += seconds;
+    }
+
+    processor.releaseResources();
+    printResult(settings, result, audioSeconds);
+
+    if (RealtimeGuard::isEnabled() && RealtimeGuard::getNumViolations() > 0)
+    {
+        std::cerr << "processBlock is not real-time safe: " << RealtimeGuard::getNumViolations()
+                  << " violation(s), last was " << RealtimeGuard::getLastViolation() << std::endl;
+        return 2;
+    }
+
+    if (result.numNonFinite > 0)
+        return 2;
+
+    return result.numOverruns > 0 ? 3 : 0;
+}
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::ArgumentList args(argc, argv);
+    StressSettings settings;
+
+    if (! parseSettings(args, settings))
+    {
+        printUsage();
+        return 1;
+    }
+
+    return settings.doublePrecision ? stress<double>(settings) : stress<float>(settings);
+}